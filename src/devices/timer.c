@@ -20,6 +20,11 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* List of threads sleeping in timer_sleep(), ordered by
+   ascending wakeup_tick.  Threads with the same wakeup tick are
+   kept in FIFO order.  Only accessed with interrupts off. */
+static struct list sleep_list;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
@@ -29,12 +34,15 @@ static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static bool wakeup_tick_less (const struct list_elem *,
+                              const struct list_elem *, void *aux);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void) 
 {
+  list_init (&sleep_list);
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
@@ -85,15 +93,26 @@ timer_elapsed (int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The running thread is put on sleep_list and blocked; it is
+   unblocked by timer_interrupt() once its wakeup tick is due, so
+   sleepers never sit on the run queue. */
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->wakeup_tick = timer_ticks () + ticks;
+  list_insert_ordered (&sleep_list, &cur->elem, wakeup_tick_less, NULL);
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -170,8 +189,39 @@ timer_print_stats (void)
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
+  bool woke = false;
+
   ticks++;
+
+  /* Wake up every sleeper whose time has come.  The list is
+     ordered, so we can stop at the first one still sleeping. */
+  while (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_tick > ticks)
+        break;
+
+      list_pop_front (&sleep_list);
+      thread_unblock (t);
+      woke = true;
+    }
+
   thread_tick ();
+
+  /* Let the scheduler decide whether a thread we woke should
+     preempt the running one. */
+  if (woke)
+    thread_yield_to_max ();
+}
+
+/* Orders sleeping threads by ascending wakeup tick. */
+static bool
+wakeup_tick_less (const struct list_elem *a, const struct list_elem *b,
+                  void *aux UNUSED)
+{
+  return list_entry (a, struct thread, elem)->wakeup_tick
+         < list_entry (b, struct thread, elem)->wakeup_tick;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
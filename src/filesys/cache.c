@@ -0,0 +1,335 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Buffer cache.
+
+   Keeps the contents of CACHE_CNT recently used sectors of the
+   file system device in memory, so that repeated reads of a
+   sector, such as an inode or a directory, and small writes do
+   not each go to the disk.  Writes are write-back: a modified
+   sector is only written to disk when it is evicted, by the
+   flusher thread every CACHE_FLUSH_SECONDS, or by cache_flush()
+   when the file system is shut down.
+
+   Sectors that are likely to be read soon can be queued with
+   cache_readahead().  The read-ahead thread loads them in the
+   background, so that a process reading a file sequentially finds
+   the next sectors already cached instead of waiting for each one
+   in turn.
+
+   Eviction uses the clock algorithm.  Each access sets an
+   entry's `accessed' bit, and the clock hand sweeps around the
+   entries, clearing set bits, until it finds an entry whose bit
+   is clear.
+
+   Locking is in two levels.  `cache_lock' protects the mapping
+   from sectors to entries, along with each entry's pin count.
+   It is held only while searching or remapping, never during
+   I/O.  Each entry also has its own lock, which protects its
+   data and is held while the data is read, written or copied, so
+   that accesses to different sectors proceed in parallel.  A
+   pinned entry, one with a nonzero pin count, is in use or about
+   to be, and is never evicted. */
+
+/* Number of cached sectors. */
+#define CACHE_CNT 64
+
+/* Interval between writes of dirty sectors to disk. */
+#define CACHE_FLUSH_SECONDS 30
+
+/* Maximum number of sectors queued for read-ahead. */
+#define READAHEAD_CNT 32
+
+/* A cached sector. */
+struct cache_entry
+  {
+    /* Protected by cache_lock. */
+    block_sector_t sector;      /* Sector cached, if `in_use'. */
+    bool in_use;                /* Whether `sector' is meaningful. */
+    int pin_cnt;                /* Number of threads using the entry. */
+
+    /* Protected by `lock'. */
+    struct lock lock;           /* Protects the fields below. */
+    bool loaded;                /* Whether `data' holds the sector. */
+    bool dirty;                 /* Whether `data' must be written back. */
+    bool accessed;              /* Used recently, for eviction. */
+    uint8_t data[BLOCK_SECTOR_SIZE]; /* Sector contents. */
+  };
+
+static struct cache_entry cache[CACHE_CNT];
+static struct lock cache_lock;          /* Protects sector mapping. */
+static struct condition cache_unpinned; /* Signaled when an entry's
+                                           pin count drops to 0. */
+static size_t clock_hand;               /* Next entry to consider. */
+
+/* Queue of sectors to read ahead, a circular buffer. */
+static block_sector_t readahead_queue[READAHEAD_CNT];
+static size_t readahead_head;           /* Index of oldest sector. */
+static size_t readahead_cnt;            /* Number of queued sectors. */
+static struct lock readahead_lock;      /* Protects the queue. */
+static struct condition readahead_ready; /* Signaled when not empty. */
+
+static thread_func flusher NO_RETURN;
+static thread_func reader NO_RETURN;
+static struct cache_entry *cache_get (block_sector_t, bool load);
+static void cache_put (struct cache_entry *);
+static void write_back (struct cache_entry *);
+
+/* Initializes the buffer cache and starts the threads that
+   periodically write dirty sectors to disk and that read ahead. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  cond_init (&cache_unpinned);
+  for (i = 0; i < CACHE_CNT; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      e->in_use = false;
+      e->pin_cnt = 0;
+      lock_init (&e->lock);
+      e->loaded = false;
+      e->dirty = false;
+      e->accessed = false;
+    }
+  clock_hand = 0;
+
+  lock_init (&readahead_lock);
+  cond_init (&readahead_ready);
+  readahead_head = readahead_cnt = 0;
+
+  thread_create ("flusher", PRI_MIN, flusher, NULL);
+  thread_create ("read-ahead", PRI_DEFAULT, reader, NULL);
+}
+
+/* Copies SIZE bytes, starting at offset OFS, of SECTOR into
+   BUFFER. */
+void
+cache_read (block_sector_t sector, void *buffer, size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs <= BLOCK_SECTOR_SIZE);
+  ASSERT (size <= BLOCK_SECTOR_SIZE - ofs);
+
+  e = cache_get (sector, true);
+  memcpy (buffer, e->data + ofs, size);
+  cache_put (e);
+}
+
+/* Copies SIZE bytes from BUFFER into SECTOR, starting at offset
+   OFS.  The sector is written to disk later.  A write of a whole
+   sector does not need to read it from disk first. */
+void
+cache_write (block_sector_t sector, const void *buffer, size_t ofs,
+             size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs <= BLOCK_SECTOR_SIZE);
+  ASSERT (size <= BLOCK_SECTOR_SIZE - ofs);
+
+  e = cache_get (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  cache_put (e);
+}
+
+/* Asks for SECTOR to be read into the cache in the background.
+   The request is dropped if too many are already queued: it is
+   only a hint. */
+void
+cache_readahead (block_sector_t sector)
+{
+  lock_acquire (&readahead_lock);
+  if (readahead_cnt < READAHEAD_CNT)
+    {
+      readahead_queue[(readahead_head + readahead_cnt++) % READAHEAD_CNT]
+        = sector;
+      cond_signal (&readahead_ready, &readahead_lock);
+    }
+  lock_release (&readahead_lock);
+}
+
+/* Writes every dirty sector in the cache to disk. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_CNT; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      lock_acquire (&cache_lock);
+      if (!e->in_use)
+        {
+          lock_release (&cache_lock);
+          continue;
+        }
+      e->pin_cnt++;
+      lock_release (&cache_lock);
+
+      lock_acquire (&e->lock);
+      write_back (e);
+      cache_put (e);
+    }
+}
+
+/* Writes dirty sectors to disk every CACHE_FLUSH_SECONDS, so
+   that a crash loses only recent writes. */
+static void
+flusher (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (CACHE_FLUSH_SECONDS * TIMER_FREQ);
+      cache_flush ();
+    }
+}
+
+/* Reads the sectors queued by cache_readahead() into the
+   cache. */
+static void
+reader (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+
+      lock_acquire (&readahead_lock);
+      while (readahead_cnt == 0)
+        cond_wait (&readahead_ready, &readahead_lock);
+      sector = readahead_queue[readahead_head];
+      readahead_head = (readahead_head + 1) % READAHEAD_CNT;
+      readahead_cnt--;
+      lock_release (&readahead_lock);
+
+      cache_put (cache_get (sector, true));
+    }
+}
+
+/* Returns the entry that holds SECTOR, which must be given back
+   with cache_put(), with its lock held.  If SECTOR is not cached,
+   evicts another sector to make room for it and reads it from
+   disk, unless LOAD is false, in which case the caller must
+   overwrite all of the entry's data. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool load)
+{
+  struct cache_entry *e;
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      /* Use SECTOR's entry if it is already cached. */
+      for (i = 0; i < CACHE_CNT; i++)
+        if (cache[i].in_use && cache[i].sector == sector)
+          break;
+      if (i < CACHE_CNT)
+        {
+          e = &cache[i];
+          break;
+        }
+
+      /* Otherwise pick a victim with the clock algorithm.  Entry
+         locks are not held here, so `accessed' is read and
+         cleared racily, which at worst picks a less ideal
+         victim.  Two sweeps are enough to find an unpinned entry
+         if there is one. */
+      e = NULL;
+      for (i = 0; i < 2 * CACHE_CNT; i++)
+        {
+          struct cache_entry *c = &cache[clock_hand];
+          clock_hand = (clock_hand + 1) % CACHE_CNT;
+          if (c->pin_cnt > 0)
+            continue;
+          if (c->in_use && c->accessed)
+            c->accessed = false;
+          else
+            {
+              e = c;
+              break;
+            }
+        }
+      if (e == NULL)
+        {
+          /* Every entry is in use.  Wait for one to be freed. */
+          cond_wait (&cache_unpinned, &cache_lock);
+          continue;
+        }
+
+      if (e->in_use && e->dirty)
+        {
+          /* Write back the victim's data without holding
+             cache_lock, then start over, since SECTOR may have
+             been cached meanwhile. */
+          e->pin_cnt++;
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          write_back (e);
+          lock_release (&e->lock);
+          lock_acquire (&cache_lock);
+          if (--e->pin_cnt == 0)
+            cond_signal (&cache_unpinned, &cache_lock);
+          continue;
+        }
+
+      /* Remap the clean victim to SECTOR.  Whoever acquires its
+         lock first will load the data. */
+      e->sector = sector;
+      e->in_use = true;
+      e->loaded = false;
+      break;
+    }
+  e->pin_cnt++;
+  lock_release (&cache_lock);
+
+  lock_acquire (&e->lock);
+  if (!e->loaded)
+    {
+      if (load)
+        block_read (fs_device, sector, e->data);
+      else
+        memset (e->data, 0, BLOCK_SECTOR_SIZE);
+      e->loaded = true;
+      e->dirty = false;
+    }
+  e->accessed = true;
+  return e;
+}
+
+/* Releases entry E, obtained from cache_get(). */
+static void
+cache_put (struct cache_entry *e)
+{
+  lock_release (&e->lock);
+
+  lock_acquire (&cache_lock);
+  if (--e->pin_cnt == 0)
+    cond_signal (&cache_unpinned, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Writes E's data to disk if it is dirty.  E's lock must be
+   held. */
+static void
+write_back (struct cache_entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&e->lock));
+
+  if (e->loaded && e->dirty)
+    {
+      block_write (fs_device, e->sector, e->data);
+      e->dirty = false;
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+void cache_init (void);
+void cache_read (block_sector_t, void *buffer, size_t ofs, size_t size);
+void cache_write (block_sector_t, const void *buffer, size_t ofs,
+                  size_t size);
+void cache_readahead (block_sector_t);
+void cache_flush (void);
+
+#endif /* filesys/cache.h */
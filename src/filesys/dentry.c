@@ -0,0 +1,191 @@
+#include "filesys/dentry.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Resolving a path such as "/a/b/c" looks up each component in
+   turn in the directory named by the previous one, which means
+   opening each of those directories and searching it.  The
+   dentry cache remembers the results of recent lookups, as a
+   mapping from a directory's inode sector and a name to the inode
+   sector that the name refers to, so that resolving a path again
+   touches no directories at all.  It also remembers names that
+   were not found ("negative" entries, with sector 0), since
+   looking up a name that does not exist, e.g. before creating a
+   file, is just as common.
+
+   The cache holds DENTRY_CNT entries and discards the least
+   recently used one when it needs room.  directory.c keeps it
+   consistent: adding or removing a name invalidates that name's
+   entry, and removing a directory purges every entry for names
+   within it, since its sector may be reused. */
+
+/* Number of entries in the cache. */
+#define DENTRY_CNT 128
+
+/* A cached lookup result. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in `dentries'. */
+    struct list_elem list_elem;         /* Element in `lru' or `unused'. */
+    block_sector_t dir;                 /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Name looked up in `dir'. */
+    block_sector_t sector;              /* Inode sector, or 0 if none. */
+  };
+
+static struct dentry dentry_pool[DENTRY_CNT];
+static struct hash dentries;            /* Cached entries, by dir and name. */
+static struct list lru;                 /* Cached entries, most recent first. */
+static struct list unused;              /* Entries not in the cache. */
+static struct lock dentry_lock;         /* Protects all of the above. */
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+static struct dentry *find (block_sector_t dir, const char *name);
+static void discard (struct dentry *);
+
+/* Initializes the dentry cache. */
+void
+dentry_init (void)
+{
+  size_t i;
+
+  if (!hash_init (&dentries, dentry_hash, dentry_less, NULL))
+    PANIC ("can't create dentry cache");
+  list_init (&lru);
+  list_init (&unused);
+  for (i = 0; i < DENTRY_CNT; i++)
+    list_push_back (&unused, &dentry_pool[i].list_elem);
+  lock_init (&dentry_lock);
+}
+
+/* Looks up NAME in directory DIR in the cache.  If the result is
+   cached, stores the inode sector that NAME refers to, or 0 if
+   NAME does not exist, into *SECTORP and returns true.  Returns
+   false if the result is not cached. */
+bool
+dentry_lookup (block_sector_t dir, const char *name, block_sector_t *sectorp)
+{
+  struct dentry *d;
+
+  lock_acquire (&dentry_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      *sectorp = d->sector;
+      list_remove (&d->list_elem);
+      list_push_front (&lru, &d->list_elem);
+    }
+  lock_release (&dentry_lock);
+
+  return d != NULL;
+}
+
+/* Records that NAME in directory DIR refers to the inode in
+   SECTOR, or does not exist if SECTOR is 0. */
+void
+dentry_insert (block_sector_t dir, const char *name, block_sector_t sector)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dentry_lock);
+  d = find (dir, name);
+  if (d == NULL)
+    {
+      if (list_empty (&unused))
+        discard (list_entry (list_back (&lru), struct dentry, list_elem));
+      d = list_entry (list_pop_front (&unused), struct dentry, list_elem);
+      d->dir = dir;
+      strlcpy (d->name, name, sizeof d->name);
+      hash_insert (&dentries, &d->hash_elem);
+    }
+  else
+    list_remove (&d->list_elem);
+  d->sector = sector;
+  list_push_front (&lru, &d->list_elem);
+  lock_release (&dentry_lock);
+}
+
+/* Forgets what is cached about NAME in directory DIR. */
+void
+dentry_invalidate (block_sector_t dir, const char *name)
+{
+  struct dentry *d;
+
+  lock_acquire (&dentry_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    discard (d);
+  lock_release (&dentry_lock);
+}
+
+/* Forgets everything cached about names in directory DIR. */
+void
+dentry_purge (block_sector_t dir)
+{
+  struct list_elem *e, *next;
+
+  lock_acquire (&dentry_lock);
+  for (e = list_begin (&lru); e != list_end (&lru); e = next)
+    {
+      struct dentry *d = list_entry (e, struct dentry, list_elem);
+      next = list_next (e);
+      if (d->dir == dir)
+        discard (d);
+    }
+  lock_release (&dentry_lock);
+}
+
+/* Returns the cached entry for NAME in DIR, or a null pointer if
+   there is none.  dentry_lock must be held. */
+static struct dentry *
+find (block_sector_t dir, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Removes D from the cache.  dentry_lock must be held. */
+static void
+discard (struct dentry *d)
+{
+  hash_delete (&dentries, &d->hash_elem);
+  list_remove (&d->list_elem);
+  list_push_front (&unused, &d->list_elem);
+}
+
+/* Returns the hash value for dentry E. */
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
@@ -0,0 +1,15 @@
+#ifndef FILESYS_DENTRY_H
+#define FILESYS_DENTRY_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+void dentry_init (void);
+bool dentry_lookup (block_sector_t dir, const char *name,
+                    block_sector_t *sectorp);
+void dentry_insert (block_sector_t dir, const char *name,
+                    block_sector_t sector);
+void dentry_invalidate (block_sector_t dir, const char *name);
+void dentry_purge (block_sector_t dir);
+
+#endif /* filesys/dentry.h */
@@ -1,10 +1,13 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dentry.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 
 /* A directory. */
 struct dir 
@@ -13,6 +16,9 @@ struct dir
     off_t pos;                          /* Current position. */
   };
 
+/* Cache of struct dir objects. */
+static struct slab_cache dir_cache;
+
 /* A single directory entry. */
 struct dir_entry 
   {
@@ -21,21 +27,110 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Directory index.
+
+   Finding a name by reading a directory's entries one by one
+   takes time proportional to the size of the directory, and so
+   does finding a free slot for a new entry.  Instead, the first
+   lookup in a directory reads all of its entries once, and builds
+   an index of them that is attached to the directory's inode with
+   inode_set_aux(), so that it is shared by everyone who has the
+   directory open and lasts as long as it stays open.  The index
+   has a hash table of the entries in use, by name, and a list of
+   the free slots.  dir_add() and dir_remove() keep it up to date.
+
+   Path resolution opens most directories only long enough for a
+   single lookup, add or remove, which would otherwise throw the
+   index away each time.  So we also keep the inodes of the
+   KEPT_DIR_CNT most recently used indexed directories open
+   ourselves, dropping a directory's when it is removed.
+
+   If memory for an index is not available, we fall back to
+   reading the directory's entries. */
+struct dir_index
+  {
+    struct hash entries;                /* Slots in use, by name. */
+    struct list free_slots;             /* Slots not in use. */
+    off_t end;                          /* Offset past the last slot. */
+  };
+
+/* A slot in a directory index. */
+struct index_slot
+  {
+    struct hash_elem hash_elem;         /* Element in `entries'. */
+    struct list_elem list_elem;         /* Element in `free_slots'. */
+    off_t ofs;                          /* Byte offset in directory. */
+    block_sector_t inode_sector;        /* Sector number of header. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+  };
+
+/* Number of recently used directory inodes kept open. */
+#define KEPT_DIR_CNT 8
+
+/* Recently used directory inodes, most recent first, followed by
+   null pointers. */
+static struct inode *kept_dirs[KEPT_DIR_CNT];
+
+static void keep_dir (struct inode *);
+static void forget_dir (struct inode *);
+static struct dir_index *get_index (const struct dir *);
+static struct index_slot *index_find (struct dir_index *, const char *name);
+static bool lookup_sector (const struct dir *, const char *name,
+                           block_sector_t *);
+static bool dir_is_empty (const struct dir *);
+
+/* Initializes the directory module. */
+void
+dir_init (void) 
+{
+  slab_cache_init (&dir_cache, "dir", sizeof (struct dir),
+                   __alignof__ (struct dir), NULL);
+}
+
+/* Closes the directories kept open by the directory module. */
+void
+dir_done (void)
+{
+  size_t i;
+
+  for (i = 0; i < KEPT_DIR_CNT; i++)
+    {
+      inode_close (kept_dirs[i]);
+      kept_dirs[i] = NULL;
+    }
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, whose parent directory is in sector PARENT.
+   Besides ENTRY_CNT, the directory has room for its "." and ".."
+   entries, which refer to itself and to PARENT.  Returns true if
+   successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, block_sector_t parent, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir *dir;
+  bool success;
+
+  if (!inode_create (sector, (entry_cnt + 2) * sizeof (struct dir_entry),
+                     true))
+    return false;
+
+  dir = dir_open (inode_open (sector));
+  success = (dir != NULL
+             && dir_add (dir, ".", sector)
+             && dir_add (dir, "..", parent));
+  dir_close (dir);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
-   it takes ownership.  Returns a null pointer on failure. */
+   it takes ownership.  Returns a null pointer on failure,
+   including if INODE is not a directory. */
 struct dir *
 dir_open (struct inode *inode) 
 {
-  struct dir *dir = calloc (1, sizeof *dir);
-  if (inode != NULL && dir != NULL)
+  struct dir *dir = slab_alloc (&dir_cache);
+  if (inode != NULL && dir != NULL && inode_is_dir (inode))
     {
       dir->inode = inode;
       dir->pos = 0;
@@ -44,7 +139,7 @@ dir_open (struct inode *inode)
   else
     {
       inode_close (inode);
-      free (dir);
+      slab_free (&dir_cache, dir);
       return NULL; 
     }
 }
@@ -72,7 +167,7 @@ dir_close (struct dir *dir)
   if (dir != NULL)
     {
       inode_close (dir->inode);
-      free (dir);
+      slab_free (&dir_cache, dir);
     }
 }
 
@@ -92,12 +187,30 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
+  struct dir_index *index;
   struct dir_entry e;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  index = get_index (dir);
+  if (index != NULL)
+    {
+      struct index_slot *s = index_find (index, name);
+      if (s == NULL)
+        return false;
+      if (ep != NULL)
+        {
+          ep->inode_sector = s->inode_sector;
+          strlcpy (ep->name, s->name, sizeof ep->name);
+          ep->in_use = true;
+        }
+      if (ofsp != NULL)
+        *ofsp = s->ofs;
+      return true;
+    }
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -119,19 +232,65 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
-  struct dir_entry e;
+  block_sector_t sector;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  if (lookup_sector (dir, name, &sector))
+    *inode = inode_open (sector);
   else
     *inode = NULL;
 
   return *inode != NULL;
 }
 
+/* Searches the directory whose inode is in DIR_SECTOR for a file
+   with the given NAME.  If one exists, stores the sector of its
+   inode into *SECTORP and returns true; otherwise, including if
+   DIR_SECTOR is not a directory, returns false.  Consults the
+   dentry cache first, so that the directory need not be opened
+   when the answer is cached. */
+bool
+dir_lookup_sector (block_sector_t dir_sector, const char *name,
+                   block_sector_t *sectorp)
+{
+  struct dir *dir;
+  bool found;
+
+  if (dentry_lookup (dir_sector, name, sectorp))
+    return *sectorp != 0;
+
+  dir = dir_open (inode_open (dir_sector));
+  if (dir == NULL)
+    return false;
+  found = lookup_sector (dir, name, sectorp);
+  dir_close (dir);
+  return found;
+}
+
+/* Like dir_lookup_sector(), for open directory DIR. */
+static bool
+lookup_sector (const struct dir *dir, const char *name,
+               block_sector_t *sectorp)
+{
+  block_sector_t dir_sector = inode_get_inumber (dir->inode);
+  struct dir_entry e;
+  bool found;
+
+  if (dentry_lookup (dir_sector, name, sectorp))
+    return *sectorp != 0;
+
+  found = lookup (dir, name, &e, NULL);
+  *sectorp = found ? e.inode_sector : 0;
+
+  /* A removed directory's sector will be reused, so nothing may
+     be cached for it after dir_remove() purged it. */
+  if (!inode_is_removed (dir->inode))
+    dentry_insert (dir_sector, name, *sectorp);
+  return found;
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
@@ -141,6 +300,8 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_index *index;
+  struct index_slot *s = NULL;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -152,21 +313,48 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  /* Nothing can be added to a directory that has been removed. */
+  if (inode_is_removed (dir->inode))
+    return false;
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  index = get_index (dir);
+  if (index != NULL)
+    {
+      /* Take a free slot, or append one. */
+      if (!list_empty (&index->free_slots))
+        {
+          s = list_entry (list_pop_front (&index->free_slots),
+                          struct index_slot, list_elem);
+          ofs = s->ofs;
+        }
+      else
+        {
+          s = malloc (sizeof *s);
+          if (s == NULL)
+            goto done;
+          ofs = s->ofs = index->end;
+        }
+    }
+  else
+    {
+      /* Set OFS to offset of free slot.
+         If there are no free slots, then it will be set to the
+         current end-of-file.
+
+         inode_read_at() will only return a short read at end of
+         file.  Otherwise, we'd need to verify that we didn't get a
+         short read due to something intermittent such as low
+         memory. */
+      for (ofs = 0;
+           inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+           ofs += sizeof e) 
+        if (!e.in_use)
+          break;
+    }
 
   /* Write slot. */
   e.in_use = true;
@@ -174,16 +362,38 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
+  if (success)
+    dentry_invalidate (inode_get_inumber (dir->inode), name);
+
+  /* Update the index. */
+  if (s != NULL)
+    {
+      if (success)
+        {
+          strlcpy (s->name, name, sizeof s->name);
+          s->inode_sector = inode_sector;
+          hash_insert (&index->entries, &s->hash_elem);
+          if (ofs == index->end)
+            index->end += sizeof e;
+        }
+      else if (ofs != index->end)
+        list_push_front (&index->free_slots, &s->list_elem);
+      else
+        free (s);
+    }
+
  done:
   return success;
 }
 
 /* Removes any entry for NAME in DIR.
-   Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   Returns true if successful, false on failure, which occurs if
+   there is no file with the given NAME, if NAME is "." or "..",
+   or if it is a directory that is not empty. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  struct dir_index *index;
   struct dir_entry e;
   struct inode *inode = NULL;
   bool success = false;
@@ -193,7 +403,8 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (name != NULL);
 
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  if (!strcmp (name, ".") || !strcmp (name, "..")
+      || !lookup (dir, name, &e, &ofs))
     goto done;
 
   /* Open inode. */
@@ -201,13 +412,41 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
+  /* Only remove a directory if it is empty. */
+  if (inode_is_dir (inode))
+    {
+      struct dir *victim = dir_open (inode_reopen (inode));
+      bool empty = victim != NULL && dir_is_empty (victim);
+      dir_close (victim);
+      if (!empty)
+        goto done;
+    }
+
   /* Erase directory entry. */
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
 
-  /* Remove inode. */
+  /* Update the index. */
+  index = get_index (dir);
+  if (index != NULL)
+    {
+      struct index_slot *s = index_find (index, name);
+      if (s != NULL)
+        {
+          hash_delete (&index->entries, &s->hash_elem);
+          list_push_front (&index->free_slots, &s->list_elem);
+        }
+    }
+
+  /* Remove inode, and anything cached about it. */
   inode_remove (inode);
+  dentry_invalidate (inode_get_inumber (dir->inode), name);
+  if (inode_is_dir (inode))
+    {
+      dentry_purge (e.inode_sector);
+      forget_dir (inode);
+    }
   success = true;
 
  done:
@@ -220,13 +459,23 @@ dir_remove (struct dir *dir, const char *name)
    contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  return dir_readdir_at (dir->inode, &dir->pos, name);
+}
+
+/* Reads the directory entry in directory INODE at or after byte
+   offset *POS, stores its name in NAME, and advances *POS past
+   it.  Returns true if successful, false if the directory
+   contains no more entries.  Skips "." and "..". */
+bool
+dir_readdir_at (struct inode *inode, off_t *pos, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  while (inode_read_at (inode, &e, sizeof e, *pos) == sizeof e) 
     {
-      dir->pos += sizeof e;
-      if (e.in_use)
+      *pos += sizeof e;
+      if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
           return true;
@@ -234,3 +483,156 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
     }
   return false;
 }
+
+/* Returns true if DIR has no entries besides "." and "..". */
+static bool
+dir_is_empty (const struct dir *dir)
+{
+  off_t pos = 0;
+  char name[NAME_MAX + 1];
+
+  return !dir_readdir_at (dir->inode, &pos, name);
+}
+
+/* Returns the hash value for index slot E. */
+static unsigned
+slot_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_string (hash_entry (e, struct index_slot, hash_elem)->name);
+}
+
+/* Returns true if index slot A's name precedes B's. */
+static bool
+slot_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  return strcmp (hash_entry (a, struct index_slot, hash_elem)->name,
+                 hash_entry (b, struct index_slot, hash_elem)->name) < 0;
+}
+
+/* Frees index slot E, which is in a hash table. */
+static void
+free_hashed_slot (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct index_slot, hash_elem));
+}
+
+/* Frees directory index INDEX_. */
+static void
+free_index (void *index_)
+{
+  struct dir_index *index = index_;
+
+  hash_destroy (&index->entries, free_hashed_slot);
+  while (!list_empty (&index->free_slots))
+    free (list_entry (list_pop_front (&index->free_slots),
+                      struct index_slot, list_elem));
+  free (index);
+}
+
+/* Moves directory INODE to the front of kept_dirs, opening it
+   again if it is not there, and closes the least recently used
+   directory if that makes too many.  A removed directory is not
+   kept, since that would keep its sectors from being freed. */
+static void
+keep_dir (struct inode *inode)
+{
+  size_t i;
+
+  if (inode_is_removed (inode))
+    return;
+
+  for (i = 0; i < KEPT_DIR_CNT - 1; i++)
+    if (kept_dirs[i] == inode || kept_dirs[i] == NULL)
+      break;
+  if (kept_dirs[i] != inode)
+    {
+      inode_close (kept_dirs[i]);
+      inode = inode_reopen (inode);
+    }
+  memmove (kept_dirs + 1, kept_dirs, i * sizeof *kept_dirs);
+  kept_dirs[0] = inode;
+}
+
+/* Removes directory INODE from kept_dirs, if it is there, and
+   closes it, so that a removed directory can be freed. */
+static void
+forget_dir (struct inode *inode)
+{
+  size_t i;
+
+  for (i = 0; i < KEPT_DIR_CNT; i++)
+    if (kept_dirs[i] == inode)
+      {
+        memmove (kept_dirs + i, kept_dirs + i + 1,
+                 (KEPT_DIR_CNT - i - 1) * sizeof *kept_dirs);
+        kept_dirs[KEPT_DIR_CNT - 1] = NULL;
+        inode_close (inode);
+        break;
+      }
+}
+
+/* Returns DIR's index, building it if there is none yet.
+   Returns a null pointer if memory is not available. */
+static struct dir_index *
+get_index (const struct dir *dir)
+{
+  struct dir_index *index = inode_get_aux (dir->inode);
+  struct dir_entry e;
+
+  if (index != NULL)
+    {
+      keep_dir (dir->inode);
+      return index;
+    }
+
+  index = malloc (sizeof *index);
+  if (index == NULL)
+    return NULL;
+  if (!hash_init (&index->entries, slot_hash, slot_less, NULL))
+    {
+      free (index);
+      return NULL;
+    }
+  list_init (&index->free_slots);
+
+  for (index->end = 0;
+       inode_read_at (dir->inode, &e, sizeof e, index->end) == sizeof e;
+       index->end += sizeof e)
+    {
+      struct index_slot *s = malloc (sizeof *s);
+      if (s == NULL)
+        {
+          free_index (index);
+          return NULL;
+        }
+      s->ofs = index->end;
+      if (e.in_use)
+        {
+          s->inode_sector = e.inode_sector;
+          strlcpy (s->name, e.name, sizeof s->name);
+          hash_insert (&index->entries, &s->hash_elem);
+        }
+      else
+        list_push_back (&index->free_slots, &s->list_elem);
+    }
+
+  inode_set_aux (dir->inode, index, free_index);
+  keep_dir (dir->inode);
+  return index;
+}
+
+/* Returns the slot in INDEX for NAME, or a null pointer if NAME
+   is not in INDEX. */
+static struct index_slot *
+index_find (struct dir_index *index, const char *name)
+{
+  struct index_slot key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&index->entries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct index_slot, hash_elem) : NULL;
+}
@@ -1,7 +1,20 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
+
+/* Read-ahead.
+
+   A file read at consecutive positions, by file_read() calls
+   each starting where the previous one ended, is probably being
+   read from start to end.  For such a file we ask the buffer
+   cache to read the sectors just past the current position in
+   the background, so that they are ready when the reader gets
+   to them.  The read-ahead window starts at READAHEAD_MIN
+   sectors and doubles with each further sequential read, up to
+   READAHEAD_MAX.  Any other access shuts it again. */
+#define READAHEAD_MIN 2
+#define READAHEAD_MAX 32
 
 /* An open file. */
 struct file 
@@ -9,26 +22,43 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    off_t ra_pos;               /* Where a sequential read would start. */
+    off_t ra_end;               /* End of data already read ahead. */
+    off_t ra_window;            /* Read-ahead window, in sectors. */
   };
 
+/* Cache of struct file objects. */
+static struct slab_cache file_cache;
+
+/* Initializes the file module. */
+void
+file_init (void) 
+{
+  slab_cache_init (&file_cache, "file", sizeof (struct file),
+                   __alignof__ (struct file), NULL);
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
 struct file *
 file_open (struct inode *inode) 
 {
-  struct file *file = calloc (1, sizeof *file);
+  struct file *file = slab_alloc (&file_cache);
   if (inode != NULL && file != NULL)
     {
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->ra_pos = 0;
+      file->ra_end = 0;
+      file->ra_window = 0;
       return file;
     }
   else
     {
       inode_close (inode);
-      free (file);
+      slab_free (&file_cache, file);
       return NULL; 
     }
 }
@@ -49,7 +79,7 @@ file_close (struct file *file)
     {
       file_allow_write (file);
       inode_close (file->inode);
-      free (file); 
+      slab_free (&file_cache, file);
     }
 }
 
@@ -69,7 +99,34 @@ off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+
+  if (file->pos == file->ra_pos)
+    {
+      if (file->ra_window == 0)
+        file->ra_window = READAHEAD_MIN;
+      else if (file->ra_window < READAHEAD_MAX)
+        file->ra_window *= 2;
+    }
+  else
+    {
+      file->ra_window = 0;
+      file->ra_end = 0;
+    }
   file->pos += bytes_read;
+  file->ra_pos = file->pos;
+
+  if (file->ra_window > 0 && bytes_read > 0)
+    {
+      /* Read ahead whatever part of the window has not been
+         requested yet. */
+      off_t start = file->ra_end > file->pos ? file->ra_end : file->pos;
+      off_t end = file->pos + file->ra_window * BLOCK_SECTOR_SIZE;
+      if (start < end)
+        {
+          inode_readahead (file->inode, end - start, start);
+          file->ra_end = end;
+        }
+    }
   return bytes_read;
 }
 
@@ -87,9 +144,8 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk is full.
+   Writing past end of file extends the file.
    Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
@@ -102,9 +158,8 @@ file_write (struct file *file, const void *buffer, off_t size)
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk is full.
+   Writing past end of file extends the file.
    The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
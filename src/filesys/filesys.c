@@ -2,15 +2,24 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dentry.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
+/* The root directory's inode, kept open so that the index of its
+   entries built by directory.c lasts between operations. */
+static struct inode *root_inode;
+
 static void do_format (void);
+static bool resolve (const char *path, block_sector_t *sectorp);
+static struct dir *open_parent (const char *path, char name[NAME_MAX + 1]);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -21,13 +30,21 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
   inode_init ();
+  file_init ();
+  dir_init ();
+  dentry_init ();
   free_map_init ();
 
   if (format) 
     do_format ();
 
   free_map_open ();
+
+  root_inode = inode_open (ROOT_DIR_SECTOR);
+  if (root_inode == NULL)
+    PANIC ("can't open root directory");
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -35,7 +52,10 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  inode_close (root_inode);
+  dir_done ();
   free_map_close ();
+  cache_flush ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -46,11 +66,34 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
+  char file_name[NAME_MAX + 1];
+  struct dir *dir = open_parent (name, file_name);
+  bool success = (dir != NULL
+                  && free_map_allocate (1, &inode_sector)
+                  && inode_create (inode_sector, initial_size, false)
+                  && dir_add (dir, file_name, inode_sector));
+  if (!success && inode_sector != 0) 
+    free_map_release (inode_sector, 1);
+  dir_close (dir);
+
+  return success;
+}
+
+/* Creates a directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name) 
+{
+  block_sector_t inode_sector = 0;
+  char dir_name[NAME_MAX + 1];
+  struct dir *dir = open_parent (name, dir_name);
   bool success = (dir != NULL
                   && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+                  && dir_create (inode_sector,
+                                 inode_get_inumber (dir_get_inode (dir)), 0)
+                  && dir_add (dir, dir_name, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
@@ -66,14 +109,11 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
-  struct inode *inode = NULL;
+  block_sector_t sector;
 
-  if (dir != NULL)
-    dir_lookup (dir, name, &inode);
-  dir_close (dir);
-
-  return file_open (inode);
+  if (!resolve (name, &sector))
+    return NULL;
+  return file_open (inode_open (sector));
 }
 
 /* Deletes the file named NAME.
@@ -83,20 +123,121 @@ filesys_open (const char *name)
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char file_name[NAME_MAX + 1];
+  struct dir *dir = open_parent (name, file_name);
+  bool success = dir != NULL && dir_remove (dir, file_name);
   dir_close (dir); 
 
   return success;
 }
-
+
+/* Changes the current thread's working directory to NAME.
+   Returns true if successful, false on failure. */
+bool
+filesys_chdir (const char *name)
+{
+  struct thread *cur = thread_current ();
+  block_sector_t sector;
+  struct inode *inode;
+
+  if (!resolve (name, &sector))
+    return false;
+  inode = inode_open (sector);
+  if (inode == NULL || !inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return false;
+    }
+
+  inode_close (cur->cwd);
+  cur->cwd = inode;
+  return true;
+}
+
+/* Splits PATH into the directory it is in and its last
+   component.  Stores the sector of the directory's inode into
+   *DIRP and the last component into NAME.  A PATH made up only of
+   slashes, i.e. the root, has "." as its last component.
+   Relative paths are resolved from the current thread's working
+   directory.  Returns false if PATH is empty, if one of its
+   components is too long, or if one of the directories leading up
+   to its last component does not exist. */
+static bool
+split_path (const char *path, block_sector_t *dirp, char name[NAME_MAX + 1])
+{
+  struct thread *cur = thread_current ();
+  block_sector_t dir;
+  bool have_name = false;
+
+  if (*path == '\0')
+    return false;
+  if (*path == '/' || cur->cwd == NULL)
+    dir = ROOT_DIR_SECTOR;
+  else
+    dir = inode_get_inumber (cur->cwd);
+
+  for (;;)
+    {
+      size_t len;
+
+      while (*path == '/')
+        path++;
+      if (*path == '\0')
+        break;
+
+      len = strcspn (path, "/");
+      if (len > NAME_MAX)
+        return false;
+
+      /* The previous component must be a directory.  Looking it up
+         usually hits the dentry cache. */
+      if (have_name && !dir_lookup_sector (dir, name, &dir))
+        return false;
+      memcpy (name, path, len);
+      name[len] = '\0';
+      have_name = true;
+      path += len;
+    }
+  if (!have_name)
+    strlcpy (name, ".", NAME_MAX + 1);
+
+  *dirp = dir;
+  return true;
+}
+
+/* Stores the sector of the inode of the file named PATH into
+   *SECTORP.  Returns true if successful, false if the file does
+   not exist. */
+static bool
+resolve (const char *path, block_sector_t *sectorp)
+{
+  char name[NAME_MAX + 1];
+  block_sector_t dir;
+
+  return (split_path (path, &dir, name)
+          && dir_lookup_sector (dir, name, sectorp));
+}
+
+/* Opens and returns the directory that PATH is in, and stores
+   PATH's last component into NAME.  Returns a null pointer if
+   the directory does not exist. */
+static struct dir *
+open_parent (const char *path, char name[NAME_MAX + 1])
+{
+  block_sector_t dir;
+
+  if (!split_path (path, &dir, name))
+    return NULL;
+  return dir_open (inode_open (dir));
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
@@ -3,21 +3,60 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Sector pointers in an inode.
+
+   An inode points to its data sectors through DIRECT_CNT direct
+   pointers, then one indirect pointer to a sector of
+   PTRS_PER_SECTOR further pointers, then one doubly indirect
+   pointer to a sector of pointers to such sectors.  A null (0)
+   pointer means that the sector has not been allocated: sector 0
+   holds the free map's inode, so it is never a data or index
+   sector.  Unallocated data sectors read as zeros, so files can
+   be sparse, and a write past end of file just allocates the
+   sectors it needs.
+
+   To keep files contiguous on disk, so that they can be read
+   ahead cheaply, a write that needs new sectors reserves them
+   from the free map as a single run when it can, or as a few
+   shorter runs when it cannot, rather than one at a time. */
+#define DIRECT_CNT 123
+#define INDIRECT_IDX DIRECT_CNT
+#define DBL_INDIRECT_IDX (DIRECT_CNT + 1)
+#define SECTOR_PTR_CNT (DIRECT_CNT + 2)
+
+/* Number of sector pointers in an index sector. */
+#define PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Maximum number of data sectors in a file. */
+#define MAX_SECTORS (DIRECT_CNT + PTRS_PER_SECTOR \
+                     + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
+    block_sector_t sectors[SECTOR_PTR_CNT]; /* Sector pointers. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t is_dir;                    /* 1 for a directory, else 0. */
+  };
+
+/* Sectors reserved from the free map for a file's new data
+   sectors, to be handed out in order. */
+struct run
+  {
+    block_sector_t next;                /* Next sector to hand out. */
+    size_t left;                        /* Number of sectors left. */
+    bool changed;                       /* Set if the inode changed. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -36,41 +75,223 @@ struct inode
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    void *aux;                          /* Data attached by the owner. */
+    inode_aux_func *aux_free;           /* Frees `aux', if nonnull. */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Allocates a sector, zeroes it, and stores it into *SECTORP.
+   Takes the sector from RUN if RUN is nonnull and not used up,
+   otherwise from the free map.  Returns true if successful,
+   false if the disk is full. */
+static bool
+allocate_sector (struct run *run, block_sector_t *sectorp)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (run != NULL && run->left > 0)
+    {
+      *sectorp = run->next++;
+      run->left--;
+    }
+  else if (!free_map_allocate (1, sectorp))
+    return false;
+  cache_write (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Returns the sector that *SLOT points to.  If *SLOT is null and
+   RUN is nonnull, first allocates a sector for it, taking it from
+   RUN unless it is to be an index sector, as INDEX says.  Returns
+   0 if the sector is not allocated. */
+static block_sector_t
+get_direct (block_sector_t *slot, struct run *run, bool index)
+{
+  if (*slot == 0 && run != NULL)
+    {
+      block_sector_t sector;
+      if (allocate_sector (index ? NULL : run, &sector))
+        {
+          *slot = sector;
+          run->changed = true;
+        }
+    }
+  return *slot;
+}
+
+/* Like get_direct(), for pointer IDX within index sector
+   INDEX_SECTOR. */
+static block_sector_t
+get_indirect (block_sector_t index_sector, size_t idx, struct run *run,
+              bool index)
+{
+  block_sector_t sector;
+
+  cache_read (index_sector, &sector, idx * sizeof sector, sizeof sector);
+  if (sector == 0 && run != NULL
+      && allocate_sector (index ? NULL : run, &sector))
+    cache_write (index_sector, &sector, idx * sizeof sector, sizeof sector);
+  return sector;
+}
+
+/* Returns the sector that holds data sector IDX of the file whose
+   on-disk inode is DISK, or 0 if it is not allocated.  If RUN is
+   nonnull, allocates the data sector and any index sectors
+   leading to it that are missing, returning 0 only if the disk is
+   full. */
+static block_sector_t
+data_sector (struct inode_disk *disk, size_t idx, struct run *run)
+{
+  block_sector_t index_sector;
+
+  ASSERT (idx < MAX_SECTORS);
+
+  if (idx < DIRECT_CNT)
+    return get_direct (&disk->sectors[idx], run, false);
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    {
+      index_sector = get_direct (&disk->sectors[INDIRECT_IDX], run, true);
+      if (index_sector == 0)
+        return 0;
+      return get_indirect (index_sector, idx, run, false);
+    }
+  idx -= PTRS_PER_SECTOR;
+
+  index_sector = get_direct (&disk->sectors[DBL_INDIRECT_IDX], run, true);
+  if (index_sector != 0)
+    index_sector = get_indirect (index_sector, idx / PTRS_PER_SECTOR,
+                                 run, true);
+  if (index_sector == 0)
+    return 0;
+  return get_indirect (index_sector, idx % PTRS_PER_SECTOR, run, false);
+}
+
+/* Reserves up to CNT contiguous sectors into RUN, settling for
+   fewer if no run of CNT free sectors exists.  Leaves RUN empty
+   if the disk is full. */
+static void
+reserve_run (struct run *run, size_t cnt)
+{
+  for (; cnt > 0; cnt /= 2)
+    if (free_map_allocate (cnt, &run->next))
+      {
+        run->left = cnt;
+        return;
+      }
+  run->left = 0;
+}
+
+/* Allocates whichever of data sectors FIRST through FIRST + CNT -
+   1 of the file whose on-disk inode is DISK are not allocated
+   yet.  Sets *CHANGED to true if DISK was modified.  Returns the
+   number of sectors, starting from FIRST, that are allocated,
+   which is less than CNT only if the disk is full. */
+static size_t
+allocate_sectors (struct inode_disk *disk, size_t first, size_t cnt,
+                  bool *changed)
+{
+  struct run run;
+  size_t i;
+
+  if (cnt > MAX_SECTORS - first)
+    cnt = first < MAX_SECTORS ? MAX_SECTORS - first : 0;
+
+  run.left = 0;
+  run.changed = false;
+  for (i = 0; i < cnt; i++)
+    {
+      if (data_sector (disk, first + i, NULL) != 0)
+        continue;
+      if (run.left == 0)
+        reserve_run (&run, cnt - i);
+      if (data_sector (disk, first + i, &run) == 0)
+        break;
+    }
+
+  /* Give back what we reserved but did not need. */
+  if (run.left > 0)
+    free_map_release (run.next, run.left);
+
+  *changed = run.changed;
+  return i;
+}
+
+/* Gives SECTOR back to the free map.  If LEVEL is nonzero, SECTOR
+   is an index sector with LEVEL levels of sectors below it, which
+   are released too. */
+static void
+release_sector (block_sector_t sector, int level)
+{
+  size_t i;
+
+  if (sector == 0)
+    return;
+
+  if (level > 0)
+    for (i = 0; i < PTRS_PER_SECTOR; i++)
+      {
+        block_sector_t child;
+        cache_read (sector, &child, i * sizeof child, sizeof child);
+        release_sector (child, level - 1);
+      }
+  free_map_release (sector, 1);
+}
+
+/* Gives all of the data and index sectors of the file whose
+   on-disk inode is DISK back to the free map. */
+static void
+release_sectors (struct inode_disk *disk)
+{
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    release_sector (disk->sectors[i], 0);
+  release_sector (disk->sectors[INDIRECT_IDX], 1);
+  release_sector (disk->sectors[DBL_INDIRECT_IDX], 2);
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   Returns 0 if INODE does not contain data for a byte at offset
+   POS, either because POS is past end of file or because the
+   sector is a hole that reads as zeros. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos) 
 {
   ASSERT (inode != NULL);
   if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+    return data_sector (&inode->data, pos / BLOCK_SECTOR_SIZE, NULL);
   else
-    return -1;
+    return 0;
 }
 
 /* List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* Cache of in-memory inodes.  A struct inode is just over 512
+   bytes, so malloc() would put it in a 1 kB block. */
+static struct slab_cache inode_cache;
+
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  slab_cache_init (&inode_cache, "inode", sizeof (struct inode),
+                   __alignof__ (struct inode), NULL);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The inode is a directory if IS_DIR is true, otherwise
+   an ordinary file.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -85,21 +306,18 @@ inode_create (block_sector_t sector, off_t length)
   if (disk_inode != NULL)
     {
       size_t sectors = bytes_to_sectors (length);
+      bool changed;
+
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      disk_inode->is_dir = is_dir;
+      if (allocate_sectors (disk_inode, 0, sectors, &changed) == sectors)
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
+          cache_write (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
           success = true; 
         } 
+      else
+        release_sectors (disk_inode);
       free (disk_inode);
     }
   return success;
@@ -127,7 +345,7 @@ inode_open (block_sector_t sector)
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = slab_alloc (&inode_cache);
   if (inode == NULL)
     return NULL;
 
@@ -137,7 +355,9 @@ inode_open (block_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->aux = NULL;
+  inode->aux_free = NULL;
+  cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
   return inode;
 }
 
@@ -172,19 +392,36 @@ inode_close (struct inode *inode)
     {
       /* Remove from inode list and release lock. */
       list_remove (&inode->elem);
+
+      if (inode->aux_free != NULL)
+        inode->aux_free (inode->aux);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          release_sectors (&inode->data);
         }
 
-      free (inode); 
+      slab_free (&inode_cache, inode);
     }
 }
 
+/* Returns true if INODE is a directory, false if it is an
+   ordinary file. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return inode->data.is_dir != 0;
+}
+
+/* Returns true if INODE has been removed with inode_remove(). */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
+}
+
 /* Marks INODE to be deleted when it is closed by the last caller who
    has it open. */
 void
@@ -202,7 +439,6 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
   while (size > 0) 
     {
@@ -220,99 +456,98 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      if (sector_idx != 0)
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
   return bytes_read;
 }
 
+/* Starts reading the SIZE bytes of INODE at OFFSET into the
+   buffer cache in the background, in anticipation of a read. */
+void
+inode_readahead (struct inode *inode, off_t size, off_t offset)
+{
+  off_t end = offset + size;
+
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  for (offset -= offset % BLOCK_SECTOR_SIZE; offset < end;
+       offset += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, offset);
+      if (sector != 0)
+        cache_readahead (sector);
+    }
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk is full or the file would exceed the
+   maximum file size.  A write past end of file extends the
+   file; any gap between the old end of file and OFFSET reads as
+   zeros. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  off_t max_length = (off_t) MAX_SECTORS * BLOCK_SECTOR_SIZE;
+  size_t first, cnt, allocated;
+  bool changed;
 
-  if (inode->deny_write_cnt)
+  if (inode->deny_write_cnt || size <= 0 || offset >= max_length)
     return 0;
+  if (size > max_length - offset)
+    size = max_length - offset;
+
+  /* Allocate the sectors we will write, if necessary. */
+  first = offset / BLOCK_SECTOR_SIZE;
+  cnt = DIV_ROUND_UP (offset + size, BLOCK_SECTOR_SIZE) - first;
+  allocated = allocate_sectors (&inode->data, first, cnt, &changed);
+  if (allocated < cnt)
+    size = (off_t) (first + allocated) * BLOCK_SECTOR_SIZE - offset;
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = data_sector (&inode->data,
+                                               offset / BLOCK_SECTOR_SIZE,
+                                               NULL);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
-
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
-        break;
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int chunk_size = size < sector_left ? size : sector_left;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      /* The cache reads in the sector first unless the chunk
+         covers all of it. */
+      cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+                   chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  /* Extend the file only once its new data is in place, so that
+     readers never see unwritten data. */
+  if (offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      changed = true;
+    }
+  if (changed)
+    cache_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
 
   return bytes_written;
 }
@@ -343,3 +578,22 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Returns the data attached to INODE with inode_set_aux(), or a
+   null pointer if there is none. */
+void *
+inode_get_aux (const struct inode *inode)
+{
+  return inode->aux;
+}
+
+/* Attaches AUX to INODE, for the use of whatever module interprets
+   INODE's data, e.g. an index of a directory's entries.  AUX lives
+   as long as INODE stays open; when it is closed for the last
+   time, AUX_FREE, if nonnull, is called to free AUX. */
+void
+inode_set_aux (struct inode *inode, void *aux, inode_aux_func *aux_free)
+{
+  inode->aux = aux;
+  inode->aux_free = aux_free;
+}
@@ -7,17 +7,26 @@
 
 struct bitmap;
 
+/* Frees the auxiliary data attached to an inode with
+   inode_set_aux(). */
+typedef void inode_aux_func (void *aux);
+
 void inode_init (void);
-bool inode_create (block_sector_t, off_t);
+bool inode_create (block_sector_t, off_t, bool is_dir);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
+bool inode_is_dir (const struct inode *);
+bool inode_is_removed (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+void inode_readahead (struct inode *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+void *inode_get_aux (const struct inode *);
+void inode_set_aux (struct inode *, void *aux, inode_aux_func *);
 
 #endif /* filesys/inode.h */
@@ -69,6 +69,32 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns the bits of B's element ELEM_IDX, with each bit set
+   if the corresponding bit of the bitmap equals VALUE. */
+static inline elem_type
+elem_matching (const struct bitmap *b, size_t elem_idx, bool value)
+{
+  elem_type bits = b->bits[elem_idx];
+  return value ? bits : ~bits;
+}
+
+/* Returns a mask of the CNT bits of an element starting at bit
+   OFS.  OFS + CNT must be no greater than ELEM_BITS. */
+static inline elem_type
+range_mask (size_t ofs, size_t cnt)
+{
+  elem_type mask = cnt < ELEM_BITS ? ((elem_type) 1 << cnt) - 1 : (elem_type) -1;
+  return mask << ofs;
+}
+
+/* Returns the number of trailing zero bits in W, which must be
+   nonzero. */
+static inline size_t
+trailing_zeros (elem_type w)
+{
+  return __builtin_ctzl (w);
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -213,18 +239,32 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Works an element at a time; each element is updated
+   atomically. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (cnt > 0)
+    {
+      size_t idx = elem_idx (start);
+      size_t ofs = start % ELEM_BITS;
+      size_t n = cnt < ELEM_BITS - ofs ? cnt : ELEM_BITS - ofs;
+      elem_type mask = range_mask (ofs, n);
+
+      /* See bitmap_mark() and bitmap_reset(). */
+      if (value)
+        asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+
+      start += n;
+      cnt -= n;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -250,15 +290,20 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
+  while (cnt > 0)
+    {
+      size_t ofs = start % ELEM_BITS;
+      size_t n = cnt < ELEM_BITS - ofs ? cnt : ELEM_BITS - ofs;
+
+      if (elem_matching (b, elem_idx (start), value) & range_mask (ofs, n))
+        return true;
+      start += n;
+      cnt -= n;
+    }
   return false;
 }
 
@@ -288,6 +333,66 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 
 /* Finding set or unset bits. */
 
+/* Finds and returns the starting index of the first group of CNT
+   consecutive bits in B that are all set to VALUE, starting at or
+   after START and ending at or before END.
+   If there is no such group, returns BITMAP_ERROR.
+
+   Works an element at a time: elements with no bit set to VALUE
+   are skipped whole, and runs of bits within an element are
+   measured by counting trailing zeros. */
+static size_t
+scan_range (const struct bitmap *b, size_t start, size_t end, size_t cnt,
+            bool value)
+{
+  size_t run_start = start;
+  size_t run_len = 0;
+  size_t i = start;
+
+  if (cnt == 0)
+    return start;
+
+  while (i < end && run_len + (end - i) >= cnt)
+    {
+      size_t ofs = i % ELEM_BITS;
+      size_t avail = ELEM_BITS - ofs < end - i ? ELEM_BITS - ofs : end - i;
+      elem_type w = (elem_matching (b, elem_idx (i), value) >> ofs)
+                    & range_mask (0, avail);
+      elem_type rest;
+      size_t ones;
+
+      if (w == 0)
+        {
+          /* No bit set to VALUE: skip the element. */
+          run_len = 0;
+          i += avail;
+          continue;
+        }
+
+      /* Extend the current run by the low bits set to VALUE. */
+      ones = ~w != 0 ? trailing_zeros (~w) : ELEM_BITS;
+      if (ones > avail)
+        ones = avail;
+      if (ones > 0)
+        {
+          if (run_len == 0)
+            run_start = i;
+          run_len += ones;
+          if (run_len >= cnt)
+            return run_start;
+          i += ones;
+          if (ones == avail)
+            continue;
+        }
+
+      /* The run is broken.  Skip to the next bit set to VALUE. */
+      run_len = 0;
+      rest = w >> ones;
+      i += rest != 0 ? trailing_zeros (rest) : avail - ones;
+    }
+  return BITMAP_ERROR;
+}
+
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
@@ -299,14 +404,38 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (start <= b->bit_cnt);
 
   if (cnt <= b->bit_cnt) 
+    return scan_range (b, start, b->bit_cnt, cnt, value);
+  return BITMAP_ERROR;
+}
+
+/* Like bitmap_scan(), but searches next-fit: starts at *CURSOR
+   and, if that fails, wraps around and searches from the start
+   of B up to *CURSOR.  On success, advances *CURSOR past the
+   group found, so that the next search resumes there.  *CURSOR
+   should be initialized to 0. */
+size_t
+bitmap_scan_next (const struct bitmap *b, size_t *cursor, size_t cnt,
+                  bool value)
+{
+  size_t start, idx;
+
+  ASSERT (b != NULL);
+  ASSERT (cursor != NULL);
+
+  if (cnt > b->bit_cnt)
+    return BITMAP_ERROR;
+
+  start = *cursor <= b->bit_cnt ? *cursor : 0;
+  idx = scan_range (b, start, b->bit_cnt, cnt, value);
+  if (idx == BITMAP_ERROR && start > 0)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      /* Groups that end past START - 1 + CNT were seen already. */
+      size_t end = start - 1 + cnt < b->bit_cnt ? start - 1 + cnt : b->bit_cnt;
+      idx = scan_range (b, 0, end, cnt, value);
     }
-  return BITMAP_ERROR;
+  if (idx != BITMAP_ERROR)
+    *cursor = idx + cnt;
+  return idx;
 }
 
 /* Finds the first group of CNT consecutive bits in B at or after
@@ -325,6 +454,18 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
   return idx;
 }
 
+/* Like bitmap_scan_and_flip(), but searches next-fit from
+   *CURSOR, as described for bitmap_scan_next(). */
+size_t
+bitmap_scan_and_flip_next (struct bitmap *b, size_t *cursor, size_t cnt,
+                           bool value)
+{
+  size_t idx = bitmap_scan_next (b, cursor, cnt, value);
+  if (idx != BITMAP_ERROR) 
+    bitmap_set_multiple (b, idx, cnt, !value);
+  return idx;
+}
+
 /* File input and output. */
 
 #ifdef FILESYS
@@ -0,0 +1,348 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* Red-black tree, following the algorithms in [CLRS] chapter 13.
+   Null child pointers play the role of the black sentinel leaves,
+   so the removal fixup tracks the parent of the possibly-null
+   node it is rebalancing around. */
+
+static bool is_red (const struct rb_node *);
+static void rotate_left (struct rb_tree *, struct rb_node *);
+static void rotate_right (struct rb_tree *, struct rb_node *);
+static void transplant (struct rb_tree *, struct rb_node *old,
+                        struct rb_node *new);
+static void insert_fixup (struct rb_tree *, struct rb_node *);
+static void remove_fixup (struct rb_tree *, struct rb_node *,
+                          struct rb_node *parent);
+static struct rb_node *subtree_min (struct rb_node *);
+
+/* Initializes TREE as an empty tree ordered by LESS, given
+   auxiliary data AUX. */
+void
+rb_init (struct rb_tree *tree, rb_less_func *less, void *aux)
+{
+  ASSERT (tree != NULL);
+  ASSERT (less != NULL);
+
+  tree->root = NULL;
+  tree->leftmost = NULL;
+  tree->size = 0;
+  tree->less = less;
+  tree->aux = aux;
+}
+
+/* Inserts NODE into TREE, after any nodes that compare equal to
+   it. */
+void
+rb_insert (struct rb_tree *tree, struct rb_node *node)
+{
+  struct rb_node *parent = NULL;
+  struct rb_node **link = &tree->root;
+  bool leftmost = true;
+
+  ASSERT (node != NULL);
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      if (tree->less (node, parent, tree->aux))
+        link = &parent->left;
+      else
+        {
+          link = &parent->right;
+          leftmost = false;
+        }
+    }
+
+  node->parent = parent;
+  node->left = node->right = NULL;
+  node->red = true;
+  *link = node;
+
+  if (leftmost)
+    tree->leftmost = node;
+  tree->size++;
+
+  insert_fixup (tree, node);
+}
+
+/* Removes NODE, which must be in TREE. */
+void
+rb_remove (struct rb_tree *tree, struct rb_node *node)
+{
+  struct rb_node *child, *parent;
+  bool removed_red;
+
+  ASSERT (node != NULL);
+  ASSERT (tree->size > 0);
+
+  if (tree->leftmost == node)
+    tree->leftmost = rb_next (node);
+
+  removed_red = node->red;
+  if (node->left == NULL)
+    {
+      child = node->right;
+      parent = node->parent;
+      transplant (tree, node, node->right);
+    }
+  else if (node->right == NULL)
+    {
+      child = node->left;
+      parent = node->parent;
+      transplant (tree, node, node->left);
+    }
+  else
+    {
+      /* Replace NODE by its successor, which has no left child. */
+      struct rb_node *succ = subtree_min (node->right);
+
+      removed_red = succ->red;
+      child = succ->right;
+      if (succ->parent == node)
+        parent = succ;
+      else
+        {
+          parent = succ->parent;
+          transplant (tree, succ, succ->right);
+          succ->right = node->right;
+          succ->right->parent = succ;
+        }
+      transplant (tree, node, succ);
+      succ->left = node->left;
+      succ->left->parent = succ;
+      succ->red = node->red;
+    }
+  tree->size--;
+
+  if (!removed_red)
+    remove_fixup (tree, child, parent);
+}
+
+/* Returns the minimum node of TREE, or a null pointer if TREE is
+   empty. */
+struct rb_node *
+rb_min (const struct rb_tree *tree)
+{
+  return tree->leftmost;
+}
+
+/* Returns the node that follows NODE in TREE's order, or a null
+   pointer if NODE is the maximum. */
+struct rb_node *
+rb_next (struct rb_node *node)
+{
+  if (node->right != NULL)
+    return subtree_min (node->right);
+
+  while (node->parent != NULL && node == node->parent->right)
+    node = node->parent;
+  return node->parent;
+}
+
+/* Returns the number of nodes in TREE. */
+size_t
+rb_size (const struct rb_tree *tree)
+{
+  return tree->size;
+}
+
+/* Returns true if TREE contains no nodes, false otherwise. */
+bool
+rb_empty (const struct rb_tree *tree)
+{
+  return tree->root == NULL;
+}
+
+/* Returns true if NODE is a red node.  Null leaves are black. */
+static bool
+is_red (const struct rb_node *node)
+{
+  return node != NULL && node->red;
+}
+
+/* Returns the minimum node in the subtree rooted at NODE. */
+static struct rb_node *
+subtree_min (struct rb_node *node)
+{
+  while (node->left != NULL)
+    node = node->left;
+  return node;
+}
+
+/* Rotates the subtree rooted at X to the left, making X's right
+   child its parent. */
+static void
+rotate_left (struct rb_tree *tree, struct rb_node *x)
+{
+  struct rb_node *y = x->right;
+
+  x->right = y->left;
+  if (y->left != NULL)
+    y->left->parent = x;
+  transplant (tree, x, y);
+  y->left = x;
+  x->parent = y;
+}
+
+/* Rotates the subtree rooted at X to the right, making X's left
+   child its parent. */
+static void
+rotate_right (struct rb_tree *tree, struct rb_node *x)
+{
+  struct rb_node *y = x->left;
+
+  x->left = y->right;
+  if (y->right != NULL)
+    y->right->parent = x;
+  transplant (tree, x, y);
+  y->right = x;
+  x->parent = y;
+}
+
+/* Makes NEW, which may be null, take OLD's place as a child of
+   OLD's parent.  OLD's own links are left untouched. */
+static void
+transplant (struct rb_tree *tree, struct rb_node *old, struct rb_node *new)
+{
+  if (old->parent == NULL)
+    tree->root = new;
+  else if (old == old->parent->left)
+    old->parent->left = new;
+  else
+    old->parent->right = new;
+
+  if (new != NULL)
+    new->parent = old->parent;
+}
+
+/* Restores the red-black properties after inserting red NODE. */
+static void
+insert_fixup (struct rb_tree *tree, struct rb_node *node)
+{
+  while (is_red (node->parent))
+    {
+      struct rb_node *parent = node->parent;
+      struct rb_node *grandparent = parent->parent;
+
+      if (parent == grandparent->left)
+        {
+          struct rb_node *uncle = grandparent->right;
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              node = grandparent;
+              continue;
+            }
+          if (node == parent->right)
+            {
+              rotate_left (tree, parent);
+              node = parent;
+              parent = node->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_right (tree, grandparent);
+        }
+      else
+        {
+          struct rb_node *uncle = grandparent->left;
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              node = grandparent;
+              continue;
+            }
+          if (node == parent->left)
+            {
+              rotate_right (tree, parent);
+              node = parent;
+              parent = node->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_left (tree, grandparent);
+        }
+    }
+  tree->root->red = false;
+}
+
+/* Restores the red-black properties after removing a black node
+   whose place was taken by NODE (possibly null), the child of
+   PARENT. */
+static void
+remove_fixup (struct rb_tree *tree, struct rb_node *node,
+              struct rb_node *parent)
+{
+  while (node != tree->root && !is_red (node))
+    {
+      if (node == parent->left)
+        {
+          struct rb_node *sibling = parent->right;
+          if (is_red (sibling))
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_left (tree, parent);
+              sibling = parent->right;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              node = parent;
+              parent = node->parent;
+            }
+          else
+            {
+              if (!is_red (sibling->right))
+                {
+                  sibling->left->red = false;
+                  sibling->red = true;
+                  rotate_right (tree, sibling);
+                  sibling = parent->right;
+                }
+              sibling->red = parent->red;
+              parent->red = false;
+              sibling->right->red = false;
+              rotate_left (tree, parent);
+              node = tree->root;
+            }
+        }
+      else
+        {
+          struct rb_node *sibling = parent->left;
+          if (is_red (sibling))
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_right (tree, parent);
+              sibling = parent->left;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              node = parent;
+              parent = node->parent;
+            }
+          else
+            {
+              if (!is_red (sibling->left))
+                {
+                  sibling->right->red = false;
+                  sibling->red = true;
+                  rotate_left (tree, sibling);
+                  sibling = parent->left;
+                }
+              sibling->red = parent->red;
+              parent->red = false;
+              sibling->left->red = false;
+              rotate_right (tree, parent);
+              node = tree->root;
+            }
+        }
+    }
+  if (node != NULL)
+    node->red = false;
+}
@@ -0,0 +1,214 @@
+/* Scheduler benchmarks.
+
+   Each benchmark starts BENCH_THREADS worker threads at spread
+   priorities, lets them run the same workload for BENCH_SECONDS,
+   and reports the number of context switches, the mean and 99th
+   percentile time spent waiting in the run queue, and the share
+   of the CPU each worker received.  The workloads are:
+
+     - sched-bench-cpu: every worker is CPU-bound.
+
+     - sched-bench-io: every worker computes for at most one tick
+       and then sleeps for 1 to 3 ticks, as if waiting for I/O.
+
+     - sched-bench-mixed: half the workers are CPU-bound, half are
+       I/O-bound.
+
+     - sched-bench-lock: every worker repeatedly holds a single
+       shared lock for about a tick, then sleeps for a tick.
+
+   These are measurements, not pass/fail tests.  To run every
+   benchmark under every scheduler, run "make build/bench" in the
+   threads directory; the results are collected in
+   build/tests/threads/sched-bench.txt. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/sched-trace.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define BENCH_THREADS 8
+#define BENCH_SECONDS 10
+
+/* Kinds of workload. */
+enum bench_kind
+  {
+    BENCH_CPU,          /* Spins for the whole run. */
+    BENCH_IO,           /* Computes briefly, then sleeps. */
+    BENCH_LOCK          /* Computes holding a shared lock, then sleeps. */
+  };
+
+struct bench_thread
+  {
+    char name[16];
+    enum bench_kind kind;
+    int priority;
+    int64_t start_time;         /* When to start working. */
+    int64_t end_time;           /* When to stop working. */
+    int tick_count;             /* Ticks observed while running. */
+    int cycle_count;            /* Completed compute/sleep cycles. */
+    struct lock *lock;          /* Shared lock, for BENCH_LOCK. */
+    struct semaphore *done;     /* Upped when the worker finishes. */
+  };
+
+static void run_bench (enum bench_kind kinds[BENCH_THREADS]);
+static void bench_thread (void *aux);
+
+void
+test_sched_bench_cpu (void)
+{
+  enum bench_kind kinds[BENCH_THREADS];
+  int i;
+
+  for (i = 0; i < BENCH_THREADS; i++)
+    kinds[i] = BENCH_CPU;
+  run_bench (kinds);
+}
+
+void
+test_sched_bench_io (void)
+{
+  enum bench_kind kinds[BENCH_THREADS];
+  int i;
+
+  for (i = 0; i < BENCH_THREADS; i++)
+    kinds[i] = BENCH_IO;
+  run_bench (kinds);
+}
+
+void
+test_sched_bench_mixed (void)
+{
+  enum bench_kind kinds[BENCH_THREADS];
+  int i;
+
+  for (i = 0; i < BENCH_THREADS; i++)
+    kinds[i] = i % 2 == 0 ? BENCH_CPU : BENCH_IO;
+  run_bench (kinds);
+}
+
+void
+test_sched_bench_lock (void)
+{
+  enum bench_kind kinds[BENCH_THREADS];
+  int i;
+
+  for (i = 0; i < BENCH_THREADS; i++)
+    kinds[i] = BENCH_LOCK;
+  run_bench (kinds);
+}
+
+/* Runs one worker of each kind in KINDS and reports. */
+static void
+run_bench (enum bench_kind kinds[BENCH_THREADS])
+{
+  static const char *kind_names[] = {"cpu", "io", "lock"};
+  struct bench_thread threads[BENCH_THREADS];
+  struct sched_trace_stats stats;
+  struct semaphore done;
+  struct lock lock;
+  int64_t start_time;
+  int total_ticks = 0;
+  int i;
+
+  /* Make sure we get to wake up and collect the results. */
+  thread_set_priority (PRI_MAX);
+
+  sema_init (&done, 0);
+  lock_init (&lock);
+  start_time = timer_ticks () + TIMER_FREQ;
+  msg ("Starting %d threads for %d seconds...", BENCH_THREADS, BENCH_SECONDS);
+  for (i = 0; i < BENCH_THREADS; i++)
+    {
+      struct bench_thread *bt = &threads[i];
+
+      snprintf (bt->name, sizeof bt->name, "%s %d", kind_names[kinds[i]], i);
+      bt->kind = kinds[i];
+      bt->priority = PRI_DEFAULT - BENCH_THREADS / 2 + i;
+      bt->start_time = start_time;
+      bt->end_time = start_time + BENCH_SECONDS * TIMER_FREQ;
+      bt->tick_count = 0;
+      bt->cycle_count = 0;
+      bt->lock = &lock;
+      bt->done = &done;
+      thread_create (bt->name, bt->priority, bench_thread, bt);
+    }
+
+  sched_trace_reset_stats ();
+  for (i = 0; i < BENCH_THREADS; i++)
+    sema_down (&done);
+  sched_trace_get_stats (&stats);
+
+  msg ("Context switches: %u", stats.switches);
+  if (stats.waits > 0)
+    {
+      unsigned mean = stats.wait_sum * 100 / stats.waits;
+      msg ("Run queue waits: %u, mean %u.%02u ticks, p99 %u ticks, "
+           "max %u ticks", stats.waits, mean / 100, mean % 100,
+           sched_trace_wait_percentile (&stats, 99), stats.wait_max);
+    }
+  else
+    msg ("Run queue waits: 0");
+
+  for (i = 0; i < BENCH_THREADS; i++)
+    total_ticks += threads[i].tick_count;
+  for (i = 0; i < BENCH_THREADS; i++)
+    {
+      struct bench_thread *bt = &threads[i];
+      int share = total_ticks > 0 ? bt->tick_count * 1000 / total_ticks : 0;
+
+      msg ("Thread %s (priority %d): %d ticks, %d.%d%% of CPU, %d cycles",
+           bt->name, bt->priority, bt->tick_count, share / 10, share % 10,
+           bt->cycle_count);
+    }
+}
+
+/* Spins until UNTIL, counting the ticks BT observes meanwhile. */
+static void
+spin_until (struct bench_thread *bt, int64_t until)
+{
+  int64_t last_time = timer_ticks ();
+  int64_t cur_time;
+
+  while ((cur_time = timer_ticks ()) < until)
+    if (cur_time != last_time)
+      {
+        bt->tick_count++;
+        last_time = cur_time;
+      }
+}
+
+static void
+bench_thread (void *bt_)
+{
+  struct bench_thread *bt = bt_;
+
+  timer_sleep (bt->start_time - timer_ticks ());
+  while (timer_ticks () < bt->end_time)
+    {
+      switch (bt->kind)
+        {
+        case BENCH_CPU:
+          spin_until (bt, bt->end_time);
+          break;
+
+        case BENCH_IO:
+          spin_until (bt, timer_ticks () + 1);
+          timer_sleep (1 + bt->cycle_count % 3);
+          break;
+
+        case BENCH_LOCK:
+          lock_acquire (bt->lock);
+          spin_until (bt, timer_ticks () + 1);
+          lock_release (bt->lock);
+          timer_sleep (1);
+          break;
+        }
+      bt->cycle_count++;
+    }
+  sema_up (bt->done);
+}
@@ -41,6 +41,10 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"sched-bench-cpu", test_sched_bench_cpu},
+    {"sched-bench-io", test_sched_bench_io},
+    {"sched-bench-mixed", test_sched_bench_mixed},
+    {"sched-bench-lock", test_sched_bench_lock},
   };
 
 static const char *test_name;
@@ -35,6 +35,10 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_sched_bench_cpu;
+extern test_func test_sched_bench_io;
+extern test_func test_sched_bench_mixed;
+extern test_func test_sched_bench_lock;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
@@ -0,0 +1,77 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point arithmetic, as used by the 4.4BSD
+   scheduler.  A fixed_t holds a real number X as the integer
+   X * FIX_F. */
+typedef int fixed_t;
+
+#define FIX_Q 14                        /* Fraction bits. */
+#define FIX_F (1 << FIX_Q)              /* Fixed-point 1. */
+
+/* Converts integer N to fixed point. */
+static inline fixed_t
+fix_int (int n)
+{
+  return n * FIX_F;
+}
+
+/* Converts X to an integer, rounding toward zero. */
+static inline int
+fix_trunc (fixed_t x)
+{
+  return x / FIX_F;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int
+fix_round (fixed_t x)
+{
+  return x >= 0 ? (x + FIX_F / 2) / FIX_F : (x - FIX_F / 2) / FIX_F;
+}
+
+/* Returns X + Y. */
+static inline fixed_t
+fix_add (fixed_t x, fixed_t y)
+{
+  return x + y;
+}
+
+/* Returns X + N, for integer N. */
+static inline fixed_t
+fix_add_int (fixed_t x, int n)
+{
+  return x + n * FIX_F;
+}
+
+/* Returns X * Y. */
+static inline fixed_t
+fix_mul (fixed_t x, fixed_t y)
+{
+  return (int64_t) x * y / FIX_F;
+}
+
+/* Returns X * N, for integer N. */
+static inline fixed_t
+fix_mul_int (fixed_t x, int n)
+{
+  return x * n;
+}
+
+/* Returns X / Y. */
+static inline fixed_t
+fix_div (fixed_t x, fixed_t y)
+{
+  return (int64_t) x * FIX_F / y;
+}
+
+/* Returns X / N, for integer N. */
+static inline fixed_t
+fix_div_int (fixed_t x, int n)
+{
+  return x / n;
+}
+
+#endif /* threads/fixed-point.h */
@@ -21,6 +21,7 @@
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/sched-trace.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -274,6 +275,10 @@ parse_options (char **argv)
         selected_scheduler = SCH_N_QUEUES;
         queueCount = atoi(value);
       }
+      else if (!strcmp (name, "-quantum"))
+        queue_quantum = atoi (value);
+      else if (!strcmp (name, "-trace"))
+        sched_trace_enabled = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -405,6 +410,8 @@ usage (void)
           "  -dynLottery        Use a dynamic prioritized Lottery as the CPU Scheduler\n"
           "  -dq                Use a dual queue CPU Scheduler\n"
           "  -nq=N              Use N Queues\n"
+          "  -quantum=TICKS     Top queue quantum for -dq and -nq (default 4).\n"
+          "  -trace             Dump the scheduler event trace at shutdown.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
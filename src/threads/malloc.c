@@ -1,10 +1,12 @@
 #include "threads/malloc.h"
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <round.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -12,7 +14,8 @@
 /* A simple implementation of malloc().
 
    The size of each request, in bytes, is rounded up to a power
-   of 2 and assigned to the "descriptor" that manages blocks of
+   of 2, or for requests over 512 bytes to a third or a half of a
+   page, and assigned to the "descriptor" that manages blocks of
    that size.  The descriptor keeps a list of free blocks.  If
    the free list is nonempty, one of its blocks is used to
    satisfy the request.
@@ -28,11 +31,46 @@
    blocks, we remove all of the arena's blocks from the free list
    and give the arena back to the page allocator.
 
-   We can't handle blocks bigger than 2 kB using this scheme,
-   because they're too big to fit in a single page with a
-   descriptor.  We handle those by allocating contiguous pages
-   with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   In front of each descriptor's free list sits a "magazine", a
+   small stack of recently freed blocks.  Pintos runs on a single
+   CPU, so the magazine plays the role of a per-CPU cache: it is
+   accessed with interrupts disabled instead of under the
+   descriptor's lock.  malloc() and free() use the magazine when
+   they can, so that a typical allocation and free touch no lock.
+   When the magazine runs empty, malloc() refills it with
+   MAG_BATCH blocks from the free list, and when it fills up,
+   free() drains MAG_BATCH blocks back to the free list, both
+   under the lock.  Blocks in a magazine count as in use as far
+   as their arenas are concerned.
+
+   We can't handle blocks bigger than about 2 kB using this
+   scheme, because they're too big to fit in a single page with a
+   descriptor.  We handle those "big blocks" by allocating
+   contiguous pages with the page allocator.  Their size is kept
+   outside the block, in a struct big_block in the big_blocks
+   hash table, so that a request for N pages takes exactly N
+   pages.  The table has a fixed number of buckets: one that grew
+   would need to allocate memory while big_lock is held, which
+   might have to come from the big block allocator itself.  Big
+   blocks are page-aligned, unlike any other block, which is how
+   free() tells them apart.  Recently freed big blocks, up to
+   BIG_CACHE_PAGES pages in all, are kept in a cache for reuse by
+   requests for the same number of pages, so that buffers freed
+   and allocated over and over do not go back and forth to the
+   page allocator.
+
+   Each descriptor counts its allocations, frees, live blocks and
+   arenas, and malloc_print_stats() reports them at shutdown.  If
+   MALLOC_TRACK is defined (add -DMALLOC_TRACK to DEFINES in a
+   Make.vars), every block also carries a hidden header recording
+   the address of the code that allocated it, and the blocks still
+   allocated at shutdown are listed along with those addresses,
+   which can be looked up with backtrace. */
+
+/* Magazine capacity, and number of blocks moved between a
+   magazine and its descriptor's free list at a time. */
+#define MAG_SIZE 16
+#define MAG_BATCH (MAG_SIZE / 2)
 
 /* Descriptor. */
 struct desc
@@ -41,6 +79,20 @@ struct desc
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+
+    /* Magazine.  Accessed only with interrupts off. */
+    struct block *mag[MAG_SIZE]; /* Recently freed blocks. */
+    size_t mag_cnt;             /* Number of blocks in mag[]. */
+
+    /* Statistics.  Block counts are updated with interrupts off,
+       arena_cnt under the lock. */
+    unsigned long long alloc_hits;   /* Allocations from magazine. */
+    unsigned long long alloc_misses; /* Allocations via free list. */
+    unsigned long long free_hits;    /* Frees into magazine. */
+    unsigned long long free_misses;  /* Frees via free list. */
+    size_t live_cnt;            /* Blocks in use. */
+    size_t peak_cnt;            /* Maximum of live_cnt. */
+    size_t arena_cnt;           /* Arenas held. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -50,8 +102,8 @@ struct desc
 struct arena 
   {
     unsigned magic;             /* Always set to ARENA_MAGIC. */
-    struct desc *desc;          /* Owning descriptor, null for big block. */
-    size_t free_cnt;            /* Free blocks; pages in big block. */
+    struct desc *desc;          /* Owning descriptor. */
+    size_t free_cnt;            /* Free blocks. */
   };
 
 /* Free block. */
@@ -64,24 +116,152 @@ struct block
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Maximum number of pages kept in the cache of freed big
+   blocks. */
+#define BIG_CACHE_PAGES 16
+
+/* Number of buckets in the big_blocks hash table. */
+#define BIG_BUCKET_CNT 64
+
+/* Big block, a run of pages from the page allocator. */
+struct big_block
+  {
+    struct list_elem hash_elem; /* Element in a big_blocks bucket. */
+    struct list_elem cache_elem; /* Element in big_cache. */
+    void *pages;                /* First page. */
+    size_t page_cnt;            /* Number of pages. */
+  };
+
+/* Big blocks.  Protected by big_lock. */
+static struct lock big_lock;
+static struct list big_blocks[BIG_BUCKET_CNT]; /* Big blocks in use,
+                                                  by address. */
+static struct list big_cache;   /* Freed big blocks, newest first. */
+static size_t big_cache_pages;  /* Pages in big_cache. */
+
+/* Big block statistics.  Protected by big_lock. */
+static unsigned long long big_alloc_cnt;  /* Big blocks allocated. */
+static unsigned long long big_free_cnt;   /* Big blocks freed. */
+static unsigned long long big_cache_hits; /* Allocations from cache. */
+static size_t big_live_pages;   /* Pages in big blocks in use. */
+static size_t big_peak_pages;   /* Maximum of big_live_pages. */
+
+#ifdef MALLOC_TRACK
+/* Hidden header in front of each block handed out by malloc(). */
+struct alloc_record
+  {
+    struct list_elem elem;      /* Element in alloc_records. */
+    void *caller;               /* Address of the allocating code. */
+    size_t size;                /* Requested size in bytes. */
+  };
+
+/* All blocks in use.  Accessed only with interrupts off. */
+static struct list alloc_records;
+
+/* Maximum number of outstanding blocks listed at shutdown. */
+#define MALLOC_TRACK_DUMP_MAX 64
+#endif
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct block *desc_alloc_block (struct desc *);
+static void desc_free_block (struct desc *, struct block *);
+static void *malloc_from (size_t, void *caller);
+static void *block_alloc (size_t);
+static void block_free (void *);
+static void *big_alloc (size_t);
+static void big_free (void *);
+static struct big_block *big_lookup (void *);
+static struct list *big_bucket (void *);
+
+/* Adds a descriptor for blocks of BLOCK_SIZE bytes. */
+static void
+init_desc (size_t block_size)
+{
+  struct desc *d = &descs[desc_cnt++];
+
+  ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+  d->block_size = block_size;
+  d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+  list_init (&d->free_list);
+  lock_init (&d->lock);
+}
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) 
 {
   size_t block_size;
+  size_t per_arena;
+  size_t i;
+
+  /* Powers of 2 up to 512 bytes, then three and two blocks per
+     arena.  A 1 kB class would also hold only three blocks per
+     arena, so it would save nothing over the three-block class. */
+  for (block_size = 16; block_size <= PGSIZE / 8; block_size *= 2)
+    init_desc (block_size);
+  for (per_arena = 3; per_arena >= 2; per_arena--)
+    init_desc (ROUND_DOWN ((PGSIZE - sizeof (struct arena)) / per_arena, 16));
+
+  lock_init (&big_lock);
+  for (i = 0; i < BIG_BUCKET_CNT; i++)
+    list_init (&big_blocks[i]);
+  list_init (&big_cache);
+#ifdef MALLOC_TRACK
+  list_init (&alloc_records);
+#endif
+}
 
-  for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
+/* Prints allocation statistics, and the blocks still in use if
+   MALLOC_TRACK is defined. */
+void
+malloc_print_stats (void)
+{
+  unsigned long long hits = 0, total = 0;
+  struct desc *d;
+
+  for (d = descs; d < descs + desc_cnt; d++)
     {
-      struct desc *d = &descs[desc_cnt++];
-      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
-      d->block_size = block_size;
-      d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
-      list_init (&d->free_list);
-      lock_init (&d->lock);
+      hits += d->alloc_hits + d->free_hits;
+      total += (d->alloc_hits + d->alloc_misses
+                + d->free_hits + d->free_misses);
     }
+  printf ("Malloc: %llu of %llu allocations and frees served by "
+          "magazines (%llu%%)\n", hits, total,
+          total > 0 ? hits * 100 / total : 0);
+
+  for (d = descs; d < descs + desc_cnt; d++)
+    if (d->alloc_hits + d->alloc_misses > 0)
+      printf ("Malloc: %4zu-byte blocks: %llu allocs, %llu frees, "
+              "%zu live (peak %zu), %zu arenas\n", d->block_size,
+              d->alloc_hits + d->alloc_misses, d->free_hits + d->free_misses,
+              d->live_cnt, d->peak_cnt, d->arena_cnt);
+  if (big_alloc_cnt > 0)
+    printf ("Malloc: big blocks: %llu allocs (%llu from cache), %llu frees, "
+            "%zu live pages (peak %zu), %zu cached pages\n",
+            big_alloc_cnt, big_cache_hits, big_free_cnt, big_live_pages,
+            big_peak_pages, big_cache_pages);
+
+#ifdef MALLOC_TRACK
+  {
+    enum intr_level old_level = intr_disable ();
+    size_t cnt = 0;
+    struct list_elem *e;
+
+    for (e = list_begin (&alloc_records); e != list_end (&alloc_records);
+         e = list_next (e))
+      {
+        struct alloc_record *r = list_entry (e, struct alloc_record, elem);
+        if (cnt++ < MALLOC_TRACK_DUMP_MAX)
+          printf ("Malloc: outstanding %zu bytes at %p from %p\n",
+                  r->size, r + 1, r->caller);
+      }
+    if (cnt > MALLOC_TRACK_DUMP_MAX)
+      printf ("Malloc: ...and %zu more outstanding blocks\n",
+              cnt - MALLOC_TRACK_DUMP_MAX);
+    intr_set_level (old_level);
+  }
+#endif
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -89,14 +269,50 @@ malloc_init (void)
 void *
 malloc (size_t size) 
 {
-  struct desc *d;
-  struct block *b;
-  struct arena *a;
+  return malloc_from (size, __builtin_return_address (0));
+}
+
+/* Allocates a block of at least SIZE bytes on behalf of the code
+   at CALLER. */
+static void *
+malloc_from (size_t size, void *caller UNUSED)
+{
+#ifdef MALLOC_TRACK
+  struct alloc_record *r;
+  enum intr_level old_level;
 
+  /* A null pointer satisfies a request for 0 bytes. */
+  if (size == 0 || size + sizeof *r < size)
+    return NULL;
+
+  r = block_alloc (size + sizeof *r);
+  if (r == NULL)
+    return NULL;
+  r->caller = caller;
+  r->size = size;
+  old_level = intr_disable ();
+  list_push_back (&alloc_records, &r->elem);
+  intr_set_level (old_level);
+  return r + 1;
+#else
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
     return NULL;
 
+  return block_alloc (size);
+#endif
+}
+
+/* Obtains and returns a new block of at least SIZE bytes, which
+   must be nonzero.  Returns a null pointer if memory is not
+   available. */
+static void *
+block_alloc (size_t size) 
+{
+  struct desc *d;
+  struct block *b;
+  enum intr_level old_level;
+
   /* Find the smallest descriptor that satisfies a SIZE-byte
      request. */
   for (d = descs; d < descs + desc_cnt; d++)
@@ -105,50 +321,47 @@ malloc (size_t size)
   if (d == descs + desc_cnt) 
     {
       /* SIZE is too big for any descriptor.
-         Allocate enough pages to hold SIZE plus an arena. */
-      size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-      a = palloc_get_multiple (0, page_cnt);
-      if (a == NULL)
-        return NULL;
+         Allocate enough pages to hold SIZE. */
+      return big_alloc (size);
+    }
 
-      /* Initialize the arena to indicate a big block of PAGE_CNT
-         pages, and return it. */
-      a->magic = ARENA_MAGIC;
-      a->desc = NULL;
-      a->free_cnt = page_cnt;
-      return a + 1;
+  /* Try the magazine first. */
+  old_level = intr_disable ();
+  if (d->mag_cnt > 0)
+    {
+      b = d->mag[--d->mag_cnt];
+      d->alloc_hits++;
+      if (++d->live_cnt > d->peak_cnt)
+        d->peak_cnt = d->live_cnt;
+      intr_set_level (old_level);
+      return b;
     }
+  d->alloc_misses++;
+  intr_set_level (old_level);
 
   lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  b = desc_alloc_block (d);
+  if (b != NULL)
     {
-      size_t i;
-
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
+      /* Refill the magazine from blocks already on the free list,
+         without creating arenas for it. */
+      struct block *refill[MAG_BATCH];
+      size_t refill_cnt = 0;
+
+      while (refill_cnt < MAG_BATCH && !list_empty (&d->free_list))
+        refill[refill_cnt++] = desc_alloc_block (d);
+
+      old_level = intr_disable ();
+      if (++d->live_cnt > d->peak_cnt)
+        d->peak_cnt = d->live_cnt;
+      while (refill_cnt > 0 && d->mag_cnt < MAG_SIZE)
+        d->mag[d->mag_cnt++] = refill[--refill_cnt];
+      intr_set_level (old_level);
+
+      /* Other threads may have filled the magazine meanwhile. */
+      while (refill_cnt > 0)
+        desc_free_block (d, refill[--refill_cnt]);
     }
-
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
   lock_release (&d->lock);
   return b;
 }
@@ -167,7 +380,7 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  p = malloc_from (size, __builtin_return_address (0));
   if (p != NULL)
     memset (p, 0, size);
 
@@ -178,11 +391,22 @@ calloc (size_t a, size_t b)
 static size_t
 block_size (void *block) 
 {
-  struct block *b = block;
-  struct arena *a = block_to_arena (b);
-  struct desc *d = a->desc;
+#ifdef MALLOC_TRACK
+  struct alloc_record *r = (struct alloc_record *) block - 1;
+  return r->size;
+#else
+  size_t size;
 
-  return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
+  if (pg_ofs (block) == 0)
+    {
+      lock_acquire (&big_lock);
+      size = big_lookup (block)->page_cnt * PGSIZE;
+      lock_release (&big_lock);
+    }
+  else
+    size = block_to_arena (block)->desc->block_size;
+  return size;
+#endif
 }
 
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
@@ -199,9 +423,15 @@ realloc (void *old_block, size_t new_size)
       free (old_block);
       return NULL;
     }
+  else if (old_block != NULL && new_size <= block_size (old_block))
+    {
+      /* The block is big enough already. */
+      return old_block;
+    }
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block = malloc_from (new_size,
+                                     __builtin_return_address (0));
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
@@ -218,51 +448,292 @@ realloc (void *old_block, size_t new_size)
 void
 free (void *p) 
 {
+#ifdef MALLOC_TRACK
   if (p != NULL)
     {
-      struct block *b = p;
-      struct arena *a = block_to_arena (b);
-      struct desc *d = a->desc;
-      
-      if (d != NULL) 
+      struct alloc_record *r = (struct alloc_record *) p - 1;
+      enum intr_level old_level = intr_disable ();
+      list_remove (&r->elem);
+      intr_set_level (old_level);
+      p = r;
+    }
+#endif
+  block_free (p);
+}
+
+/* Frees block P, which must have been previously allocated with
+   block_alloc(), or does nothing if P is null. */
+static void
+block_free (void *p) 
+{
+  if (p != NULL)
+    {
+      if (pg_ofs (p) != 0) 
         {
           /* It's a normal block.  We handle it here. */
+          struct block *b = p;
+          struct arena *a = block_to_arena (b);
+          struct desc *d = a->desc;
+          struct block *drain[MAG_BATCH];
+          size_t drain_cnt = 0;
+          enum intr_level old_level;
 
 #ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
 
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          /* Put the block in the magazine, first draining part of
+             the magazine if it is full. */
+          old_level = intr_disable ();
+          d->live_cnt--;
+          if (d->mag_cnt < MAG_SIZE)
+            d->free_hits++;
+          else
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              d->free_misses++;
+              while (drain_cnt < MAG_BATCH)
+                drain[drain_cnt++] = d->mag[--d->mag_cnt];
             }
+          d->mag[d->mag_cnt++] = b;
+          intr_set_level (old_level);
 
-          lock_release (&d->lock);
+          if (drain_cnt > 0)
+            {
+              lock_acquire (&d->lock);
+              while (drain_cnt > 0)
+                desc_free_block (d, drain[--drain_cnt]);
+              lock_release (&d->lock);
+            }
         }
       else
         {
-          /* It's a big block.  Free its pages. */
-          palloc_free_multiple (a, a->free_cnt);
-          return;
+          /* It's a big block. */
+          big_free (p);
+        }
+    }
+}
+
+/* Allocates and returns a big block of SIZE bytes, rounded up to
+   whole pages, reusing a cached block of the same number of pages
+   if there is one.  Returns a null pointer if memory is not
+   available. */
+static void *
+big_alloc (size_t size)
+{
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  struct big_block *bb = NULL;
+  struct list_elem *e;
+
+  /* Look in the cache. */
+  lock_acquire (&big_lock);
+  for (e = list_begin (&big_cache); e != list_end (&big_cache);
+       e = list_next (e))
+    {
+      struct big_block *cached = list_entry (e, struct big_block, cache_elem);
+      if (cached->page_cnt == page_cnt)
+        {
+          list_remove (&cached->cache_elem);
+          big_cache_pages -= page_cnt;
+          big_cache_hits++;
+          bb = cached;
+          break;
+        }
+    }
+  lock_release (&big_lock);
+
+  /* Get new pages if the cache had none.  The header comes from
+     block_alloc(), not malloc(), so that MALLOC_TRACK does not
+     report headers of cached blocks as leaks. */
+  if (bb == NULL)
+    {
+      bb = block_alloc (sizeof *bb);
+      if (bb == NULL)
+        return NULL;
+      bb->page_cnt = page_cnt;
+      bb->pages = palloc_get_multiple (0, page_cnt);
+      if (bb->pages == NULL)
+        {
+          /* Give the cached blocks back and try again. */
+          struct list flushed;
+
+          list_init (&flushed);
+          lock_acquire (&big_lock);
+          while (!list_empty (&big_cache))
+            list_push_back (&flushed, list_pop_front (&big_cache));
+          big_cache_pages = 0;
+          lock_release (&big_lock);
+
+          while (!list_empty (&flushed))
+            {
+              struct big_block *cached = list_entry (list_pop_front (&flushed),
+                                                     struct big_block,
+                                                     cache_elem);
+              palloc_free_multiple (cached->pages, cached->page_cnt);
+              block_free (cached);
+            }
+
+          bb->pages = palloc_get_multiple (0, page_cnt);
+          if (bb->pages == NULL)
+            {
+              block_free (bb);
+              return NULL;
+            }
+        }
+    }
+
+  lock_acquire (&big_lock);
+  list_push_front (big_bucket (bb->pages), &bb->hash_elem);
+  big_alloc_cnt++;
+  big_live_pages += page_cnt;
+  if (big_live_pages > big_peak_pages)
+    big_peak_pages = big_live_pages;
+  lock_release (&big_lock);
+
+  return bb->pages;
+}
+
+/* Frees big block P, putting it in the cache of freed big blocks
+   and giving the oldest cached blocks back to the page allocator
+   if that makes the cache too big. */
+static void
+big_free (void *p)
+{
+  struct big_block *bb;
+  struct list evicted;
+
+  list_init (&evicted);
+  lock_acquire (&big_lock);
+  bb = big_lookup (p);
+  list_remove (&bb->hash_elem);
+  big_free_cnt++;
+  big_live_pages -= bb->page_cnt;
+
+#ifndef NDEBUG
+  /* Clear the block to help detect use-after-free bugs, unless it
+     is about to be freed, which clears it anyway.  This must
+     happen before the block goes into the cache, where another
+     thread may take it as soon as we release big_lock. */
+  if (bb->page_cnt <= BIG_CACHE_PAGES)
+    memset (p, 0xcc, bb->page_cnt * PGSIZE);
+#endif
+
+  list_push_front (&big_cache, &bb->cache_elem);
+  big_cache_pages += bb->page_cnt;
+  while (big_cache_pages > BIG_CACHE_PAGES)
+    {
+      struct big_block *old = list_entry (list_pop_back (&big_cache),
+                                          struct big_block, cache_elem);
+      big_cache_pages -= old->page_cnt;
+      list_push_back (&evicted, &old->cache_elem);
+    }
+  lock_release (&big_lock);
+
+  while (!list_empty (&evicted))
+    {
+      struct big_block *old = list_entry (list_pop_front (&evicted),
+                                          struct big_block, cache_elem);
+      palloc_free_multiple (old->pages, old->page_cnt);
+      block_free (old);
+    }
+}
+
+/* Returns the big block in use that starts at P, which must
+   exist.  big_lock must be held. */
+static struct big_block *
+big_lookup (void *p)
+{
+  struct list *bucket = big_bucket (p);
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&big_lock));
+
+  for (e = list_begin (bucket); e != list_end (bucket); e = list_next (e))
+    {
+      struct big_block *bb = list_entry (e, struct big_block, hash_elem);
+      if (bb->pages == p)
+        return bb;
+    }
+  NOT_REACHED ();
+}
+
+/* Returns the big_blocks bucket for a big block starting at P. */
+static struct list *
+big_bucket (void *p)
+{
+  return &big_blocks[hash_int (pg_no (p)) % BIG_BUCKET_CNT];
+}
+
+/* Takes a block from D's free list, creating a new arena if the
+   free list is empty, and returns it.  Returns a null pointer if
+   no memory is available.  D's lock must be held. */
+static struct block *
+desc_alloc_block (struct desc *d)
+{
+  struct block *b;
+  struct arena *a;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* If the free list is empty, create a new arena. */
+  if (list_empty (&d->free_list))
+    {
+      size_t i;
+
+      /* Allocate a page. */
+      a = palloc_get_page (0);
+      if (a == NULL) 
+        return NULL; 
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      d->arena_cnt++;
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_push_back (&d->free_list, &b->free_elem);
+        }
+    }
+
+  /* Get a block from free list and return it. */
+  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+  a = block_to_arena (b);
+  a->free_cnt--;
+  return b;
+}
+
+/* Returns block B to D's free list, giving its arena back to the
+   page allocator if the arena is now entirely unused.  D's lock
+   must be held. */
+static void
+desc_free_block (struct desc *d, struct block *b)
+{
+  struct arena *a = block_to_arena (b);
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+  ASSERT (a->desc == d);
+
+  /* Add block to free list. */
+  list_push_front (&d->free_list, &b->free_elem);
+
+  /* If the arena is now entirely unused, free it. */
+  if (++a->free_cnt >= d->blocks_per_arena) 
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_remove (&b->free_elem);
         }
+      palloc_free_page (a);
+      d->arena_cnt--;
     }
 }
-
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -274,9 +745,8 @@ block_to_arena (struct block *b)
   ASSERT (a->magic == ARENA_MAGIC);
 
   /* Check that the block is properly aligned for the arena. */
-  ASSERT (a->desc == NULL
-          || (pg_ofs (b) - sizeof *a) % a->desc->block_size == 0);
-  ASSERT (a->desc != NULL || pg_ofs (b) == sizeof *a);
+  ASSERT (a->desc != NULL);
+  ASSERT ((pg_ofs (b) - sizeof *a) % a->desc->block_size == 0);
 
   return a;
 }
@@ -2,11 +2,13 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -23,14 +25,63 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed by a binary buddy allocator.  A free block
+   of order K is 2**K pages long and starts at a page index (within
+   the pool) that is a multiple of 2**K.  Free blocks are kept on
+   one list per order, linked through a list_elem stored in their
+   first page, and the first page of each free block has its order
+   recorded in the pool's `order' array.  Requests round up to the
+   next order, splitting larger blocks as needed, and the unused
+   tail is given back right away, so that a request for PAGE_CNT
+   pages consumes exactly PAGE_CNT pages.  Freed blocks are merged
+   with their buddies as long as possible.  Allocation and freeing
+   thus take O(log n) time instead of a linear bitmap scan.
+
+   If PALLOC_DEBUG is defined (add -DPALLOC_DEBUG to DEFINES in a
+   Make.vars), each pool also keeps the original bitmap of used
+   pages, which is used to check every allocation and free.
+
+   To keep zeroing off the critical path, the idle thread calls
+   palloc_zero_idle() to take free pages out of each pool, zero
+   them, and keep up to ZERO_POOL_MAX of them on the pool's
+   `zeroed' list.  Single-page PAL_ZERO requests are served from
+   that list when possible and zeroed inline otherwise.  If a pool
+   runs out of free pages, the zeroed pages go back to it before
+   the request fails. */
+
+/* Number of block orders.  The largest block is 2**(BUDDY_ORDERS
+   - 1) pages, which is more than the 4 GB of address space. */
+#define BUDDY_ORDERS 21
+
+/* Maximum number of pre-zeroed pages kept by a pool. */
+#define ZERO_POOL_MAX 32
+
+/* Marks the first page of a free block in a pool's `order'
+   array, which holds BUDDY_FREE | K for a free block of order K
+   and 0 for any other page. */
+#define BUDDY_FREE 0x80
 
 /* A memory pool. */
 struct pool
   {
     struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    const char *name;                   /* Name, for statistics. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages in pool. */
+    size_t used_cnt;                    /* Number of pages in use. */
+    size_t peak_cnt;                    /* Maximum of used_cnt. */
+    uint8_t *order;                     /* Free block order per page. */
+    struct list free[BUDDY_ORDERS];     /* Free blocks of each order. */
+#ifdef PALLOC_DEBUG
+    struct bitmap *used_map;            /* Bitmap of used pages. */
+#endif
+
+    /* Pre-zeroed pages, which count as used in the fields above.
+       Accessed only with interrupts off. */
+    struct list zeroed;                 /* Zeroed pages. */
+    size_t zeroed_cnt;                  /* Number of zeroed pages. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +90,15 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static void print_pool_stats (struct pool *);
+static size_t pool_alloc (struct pool *, size_t page_cnt);
+static void pool_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void *take_zeroed_page (struct pool *);
+static void release_zeroed_pages (struct pool *);
+static bool zero_free_page (struct pool *);
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void buddy_free_block (struct pool *, size_t page_idx, int order);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -77,8 +137,22 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (page_cnt == 0)
     return NULL;
 
+  /* Use a pre-zeroed page if we can. */
+  if (page_cnt == 1 && (flags & PAL_ZERO))
+    {
+      pages = take_zeroed_page (pool);
+      if (pages != NULL)
+        return pages;
+    }
+
   lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+  page_idx = pool_alloc (pool, page_cnt);
+  if (page_idx == BITMAP_ERROR && pool->zeroed_cnt > 0)
+    {
+      /* Give the pre-zeroed pages back and try again. */
+      release_zeroed_pages (pool);
+      page_idx = pool_alloc (pool, page_cnt);
+    }
   lock_release (&pool->lock);
 
   if (page_idx != BITMAP_ERROR)
@@ -137,8 +211,24 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  lock_acquire (&pool->lock);
+  pool_free (pool, page_idx, page_cnt);
+  lock_release (&pool->lock);
+}
+
+/* Zeroes a free page for the pre-zeroed list of the kernel or the
+   user pool, if either needs one.  Returns true if a page was
+   zeroed, false if there was nothing to do.
+
+   Called by the idle thread, which must never block.  So the
+   pool's lock is only tried, never waited for, and with
+   interrupts off, so that no other thread can wait for the lock
+   while the idle thread holds it.  The page itself is zeroed with
+   interrupts on and no lock held. */
+bool
+palloc_zero_idle (void)
+{
+  return zero_free_page (&kernel_pool) || zero_free_page (&user_pool);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +238,86 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  print_pool_stats (&kernel_pool);
+  print_pool_stats (&user_pool);
+}
+
+/* Prints the usage of POOL and a histogram of its free blocks,
+   by size in pages.  This runs on the panic path too, possibly in
+   an interrupt handler or with POOL's lock held, so it takes a
+   snapshot with interrupts off instead of acquiring the lock.
+   The snapshot may catch an allocation half done, which is good
+   enough for statistics. */
+static void
+print_pool_stats (struct pool *pool)
+{
+  size_t free_cnt[BUDDY_ORDERS];
+  size_t used_cnt, peak_cnt, zeroed_cnt;
+  enum intr_level old_level;
+  int i;
+
+  old_level = intr_disable ();
+  used_cnt = pool->used_cnt;
+  peak_cnt = pool->peak_cnt;
+  zeroed_cnt = pool->zeroed_cnt;
+  for (i = 0; i < BUDDY_ORDERS; i++)
+    free_cnt[i] = list_size (&pool->free[i]);
+  intr_set_level (old_level);
+
+  printf ("Palloc: %s: %zu of %zu pages in use (peak %zu), %zu pre-zeroed, "
+          "free blocks:", pool->name, used_cnt - zeroed_cnt,
+          pool->page_cnt, peak_cnt, zeroed_cnt);
+  for (i = 0; i < BUDDY_ORDERS; i++)
+    if (free_cnt[i] > 0)
+      printf (" %zux%zu", free_cnt[i], (size_t) 1 << i);
+  printf ("\n");
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  /* We'll put the pool's order array (and used_map, if any) at
+     its base.  Calculate the space needed for them and subtract
+     it from the pool's size. */
+  size_t meta_size = page_cnt;
+  size_t meta_pages;
+  int i;
+
+#ifdef PALLOC_DEBUG
+  meta_size += bitmap_buf_size (page_cnt);
+#endif
+  meta_pages = DIV_ROUND_UP (meta_size, PGSIZE);
+  if (meta_pages > page_cnt)
+    PANIC ("Not enough memory in %s for page map.", name);
+  page_cnt -= meta_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
   lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  p->name = name;
+  p->base = (uint8_t *) base + meta_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  p->used_cnt = p->peak_cnt = 0;
+  list_init (&p->zeroed);
+  p->zeroed_cnt = 0;
+  p->order = base;
+  memset (p->order, 0, page_cnt);
+  for (i = 0; i < BUDDY_ORDERS; i++)
+    list_init (&p->free[i]);
+#ifdef PALLOC_DEBUG
+  p->used_map = bitmap_create_in_buf (page_cnt, p->order + page_cnt,
+                                      meta_pages * PGSIZE - page_cnt);
+#endif
+
+  /* Put all the pages on the free lists. */
+  buddy_free (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +327,226 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Allocates PAGE_CNT contiguous pages from POOL, updating its
+   statistics, and returns the index of the first one, or
+   BITMAP_ERROR on failure.  POOL's lock must be held. */
+static size_t
+pool_alloc (struct pool *pool, size_t page_cnt)
+{
+  size_t page_idx = buddy_alloc (pool, page_cnt);
+
+  if (page_idx != BITMAP_ERROR)
+    {
+      pool->used_cnt += page_cnt;
+      if (pool->used_cnt > pool->peak_cnt)
+        pool->peak_cnt = pool->used_cnt;
+#ifdef PALLOC_DEBUG
+      ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+#endif
+    }
+  return page_idx;
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, updating
+   its statistics.  POOL's lock must be held. */
+static void
+pool_free (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+#ifdef PALLOC_DEBUG
+  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+#endif
+  buddy_free (pool, page_idx, page_cnt);
+  pool->used_cnt -= page_cnt;
+}
+
+/* Removes and returns a page from POOL's pre-zeroed list, or
+   returns a null pointer if the list is empty. */
+static void *
+take_zeroed_page (struct pool *pool)
+{
+  struct list_elem *e = NULL;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (!list_empty (&pool->zeroed))
+    {
+      e = list_pop_front (&pool->zeroed);
+      pool->zeroed_cnt--;
+    }
+  intr_set_level (old_level);
+
+  /* The list element was the only nonzero part of the page. */
+  if (e != NULL)
+    memset (e, 0, sizeof *e);
+  return e;
+}
+
+/* Frees all of POOL's pre-zeroed pages.  POOL's lock must be
+   held. */
+static void
+release_zeroed_pages (struct pool *pool)
+{
+  void *page;
+
+  while ((page = take_zeroed_page (pool)) != NULL)
+    pool_free (pool, pg_no (page) - pg_no (pool->base), 1);
+}
+
+/* Zeroes a free page of POOL and adds it to POOL's pre-zeroed
+   list, if the list is short, the pool has free pages to spare,
+   and POOL's lock is free.  Returns true if successful, false
+   otherwise.  See palloc_zero_idle(). */
+static bool
+zero_free_page (struct pool *pool)
+{
+  size_t page_idx = BITMAP_ERROR;
+  enum intr_level old_level;
+  uint8_t *page;
+
+  if (pool->zeroed_cnt >= ZERO_POOL_MAX
+      || pool->page_cnt - pool->used_cnt <= ZERO_POOL_MAX)
+    return false;
+
+  old_level = intr_disable ();
+  if (lock_try_acquire (&pool->lock))
+    {
+      page_idx = pool_alloc (pool, 1);
+      lock_release (&pool->lock);
+    }
+  intr_set_level (old_level);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  page = pool->base + PGSIZE * page_idx;
+  memset (page, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  list_push_back (&pool->zeroed, (struct list_elem *) page);
+  pool->zeroed_cnt++;
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Returns the order of the smallest block that holds PAGE_CNT
+   pages. */
+static int
+order_for (size_t page_cnt)
+{
+  int order = 0;
+
+  while ((size_t) 1 << order < page_cnt)
+    order++;
+  return order;
+}
+
+/* Returns the list_elem stored in the first page of the free
+   block at PAGE_IDX in POOL. */
+static struct list_elem *
+block_elem (struct pool *pool, size_t page_idx)
+{
+  return (struct list_elem *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the index within POOL of the page that holds E. */
+static size_t
+elem_page_idx (struct pool *pool, struct list_elem *e)
+{
+  return ((uint8_t *) e - pool->base) / PGSIZE;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first one, or BITMAP_ERROR if no free block is big
+   enough.  POOL's lock must be held. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt)
+{
+  int order = order_for (page_cnt);
+  size_t page_idx;
+  int i;
+
+  if (order >= BUDDY_ORDERS)
+    return BITMAP_ERROR;
+
+  /* Find the smallest free block that is big enough. */
+  for (i = order; i < BUDDY_ORDERS; i++)
+    if (!list_empty (&pool->free[i]))
+      break;
+  if (i >= BUDDY_ORDERS)
+    return BITMAP_ERROR;
+
+  page_idx = elem_page_idx (pool, list_pop_front (&pool->free[i]));
+  pool->order[page_idx] = 0;
+
+  /* Split it down to ORDER, freeing the upper halves. */
+  while (i > order)
+    {
+      size_t buddy_idx;
+
+      i--;
+      buddy_idx = page_idx + ((size_t) 1 << i);
+      pool->order[buddy_idx] = BUDDY_FREE | i;
+      list_push_front (&pool->free[i], block_elem (pool, buddy_idx));
+    }
+
+  /* Give back the pages past PAGE_CNT. */
+  if (page_cnt < (size_t) 1 << order)
+    buddy_free (pool, page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+
+  return page_idx;
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, as the
+   largest aligned blocks that cover them.  POOL's lock must be
+   held. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+
+      while (order + 1 < BUDDY_ORDERS
+             && page_idx % ((size_t) 2 << order) == 0
+             && (size_t) 2 << order <= page_cnt)
+        order++;
+
+      buddy_free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Frees the block of order ORDER at PAGE_IDX in POOL, merging it
+   with its buddy for as long as the buddy is free too.  POOL's
+   lock must be held. */
+static void
+buddy_free_block (struct pool *pool, size_t page_idx, int order)
+{
+  ASSERT (page_idx % ((size_t) 1 << order) == 0);
+  ASSERT (page_idx + ((size_t) 1 << order) <= pool->page_cnt);
+
+  while (order + 1 < BUDDY_ORDERS)
+    {
+      size_t buddy_idx = page_idx ^ ((size_t) 1 << order);
+
+      if (buddy_idx >= pool->page_cnt
+          || pool->order[buddy_idx] != (BUDDY_FREE | order))
+        break;
+
+      list_remove (block_elem (pool, buddy_idx));
+      pool->order[buddy_idx] = 0;
+      if (buddy_idx < page_idx)
+        page_idx = buddy_idx;
+      order++;
+    }
+
+  pool->order[page_idx] = BUDDY_FREE | order;
+  list_push_front (&pool->free[order], block_elem (pool, page_idx));
+}
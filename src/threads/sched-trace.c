@@ -0,0 +1,189 @@
+#include "threads/sched-trace.h"
+#include <debug.h>
+#include <packed.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+
+/* Number of events kept.  Must be a power of 2. */
+#define SCHED_TRACE_SIZE 4096
+
+/* One event, as recorded and as dumped. */
+struct sched_event
+  {
+    uint32_t tick;              /* timer_ticks() at the event. */
+    uint16_t from;              /* Thread switched out or waker. */
+    uint16_t to;                /* Thread switched in or woken. */
+    uint8_t type;               /* enum sched_event_type. */
+  }
+PACKED;
+
+/* Header preceding the events in a dump.  All fields are little
+   endian, as on the x86. */
+struct sched_trace_header
+  {
+    char magic[4];              /* "PSTR". */
+    uint8_t version;            /* Format version, currently 1. */
+    uint8_t event_size;         /* sizeof (struct sched_event). */
+    uint8_t scheduler;          /* enum scheduling_algorithm. */
+    uint8_t reserved;           /* Zero. */
+    uint16_t timer_freq;        /* TIMER_FREQ, ticks per second. */
+    uint32_t count;             /* Number of events that follow. */
+    uint32_t dropped;           /* Older events overwritten. */
+  }
+PACKED;
+
+/* Number of bytes printed per line of a dump. */
+#define DUMP_LINE_BYTES 32
+
+bool sched_trace_enabled;
+
+/* Ring buffer.  EVENT_CNT counts every event ever recorded, so
+   the next slot is EVENT_CNT % SCHED_TRACE_SIZE. */
+static struct sched_event events[SCHED_TRACE_SIZE];
+static uint32_t event_cnt;
+
+/* Running summary, see sched_trace_reset_stats(). */
+static struct sched_trace_stats stats;
+
+static void dump_bytes (const void *, size_t, size_t *col);
+
+/* Records an event of the given TYPE between threads FROM and TO
+   (null if not applicable), and accounts the time TO spent in the
+   run queue when it is switched in.  Must be called with
+   interrupts off. */
+void
+sched_trace_record (enum sched_event_type type,
+                    struct thread *from, struct thread *to)
+{
+  int64_t now = timer_ticks ();
+  struct sched_event *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  e = &events[event_cnt++ % SCHED_TRACE_SIZE];
+  e->tick = now;
+  e->from = from != NULL ? from->tid : 0;
+  e->to = to != NULL ? to->tid : 0;
+  e->type = type;
+
+  if (type == SCHED_EV_UNBLOCK)
+    to->ready_tick = now;
+  else if (type != SCHED_EV_BLOCK && from != to)
+    {
+      if (type == SCHED_EV_YIELD)
+        from->ready_tick = now;
+      stats.switches++;
+
+      /* The idle thread is switched in without having been
+         ready, so it does not count as a wait. */
+      if (to->status == THREAD_READY)
+        {
+          unsigned wait = now - to->ready_tick;
+
+          to->ready_state_time += wait;
+          stats.waits++;
+          stats.wait_sum += wait;
+          if (wait > stats.wait_max)
+            stats.wait_max = wait;
+          stats.wait_hist[wait < SCHED_TRACE_WAIT_MAX
+                          ? wait : SCHED_TRACE_WAIT_MAX]++;
+        }
+    }
+}
+
+/* Clears the running summary of scheduling events. */
+void
+sched_trace_reset_stats (void)
+{
+  enum intr_level old_level = intr_disable ();
+  memset (&stats, 0, sizeof stats);
+  intr_set_level (old_level);
+}
+
+/* Copies the running summary of scheduling events into S. */
+void
+sched_trace_get_stats (struct sched_trace_stats *s)
+{
+  enum intr_level old_level = intr_disable ();
+  *s = stats;
+  intr_set_level (old_level);
+}
+
+/* Returns the smallest wait, in ticks, that at least PERCENT
+   percent of the waits in S do not exceed. */
+unsigned
+sched_trace_wait_percentile (const struct sched_trace_stats *s,
+                             unsigned percent)
+{
+  uint64_t target = ((uint64_t) s->waits * percent + 99) / 100;
+  uint64_t seen = 0;
+  unsigned wait;
+
+  for (wait = 0; wait < SCHED_TRACE_WAIT_MAX; wait++)
+    {
+      seen += s->wait_hist[wait];
+      if (seen >= target)
+        return wait;
+    }
+  return s->wait_max;
+}
+
+/* Prints the recorded events, oldest first, as hex lines
+   prefixed by "sched-trace: ", between a "begin" and an "end"
+   line.  Does nothing unless the "-trace" option was given. */
+void
+sched_trace_dump (void)
+{
+  struct sched_trace_header h;
+  enum intr_level old_level;
+  uint32_t first, i;
+  size_t col = 0;
+
+  if (!sched_trace_enabled)
+    return;
+
+  old_level = intr_disable ();
+  memcpy (h.magic, "PSTR", sizeof h.magic);
+  h.version = 1;
+  h.event_size = sizeof (struct sched_event);
+  h.scheduler = selected_scheduler;
+  h.reserved = 0;
+  h.timer_freq = TIMER_FREQ;
+  h.count = event_cnt < SCHED_TRACE_SIZE ? event_cnt : SCHED_TRACE_SIZE;
+  h.dropped = event_cnt - h.count;
+  first = event_cnt - h.count;
+
+  printf ("sched-trace: begin\n");
+  dump_bytes (&h, sizeof h, &col);
+  for (i = 0; i < h.count; i++)
+    dump_bytes (&events[(first + i) % SCHED_TRACE_SIZE],
+                sizeof (struct sched_event), &col);
+  if (col != 0)
+    printf ("\n");
+  printf ("sched-trace: end\n");
+  intr_set_level (old_level);
+}
+
+/* Prints SIZE bytes from BUF in hex, continuing a line that has
+   *COL bytes so far and starting a new one every
+   DUMP_LINE_BYTES. */
+static void
+dump_bytes (const void *buf_, size_t size, size_t *col)
+{
+  const uint8_t *buf = buf_;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    {
+      if (*col == 0)
+        printf ("sched-trace: ");
+      printf ("%02x", buf[i]);
+      if (++*col == DUMP_LINE_BYTES)
+        {
+          printf ("\n");
+          *col = 0;
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef THREADS_SCHED_TRACE_H
+#define THREADS_SCHED_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/thread.h"
+
+/* Scheduler event tracing.
+
+   Every scheduling event is recorded in a fixed-size ring buffer,
+   overwriting the oldest events once it fills up.  Recording
+   happens with interrupts off, so it needs no lock.  With the
+   kernel command-line option "-trace", the buffer is dumped to the
+   console at shutdown; utils/sched-trace decodes the dump into
+   ready-wait histograms and latency percentiles.
+
+   Independently of the ring buffer, which may wrap around, a
+   running summary of context switches and run queue waits is kept
+   for in-kernel benchmarks. */
+
+/* Kinds of scheduling events. */
+enum sched_event_type
+  {
+    SCHED_EV_UNBLOCK,   /* TO was made ready by FROM. */
+    SCHED_EV_BLOCK,     /* FROM blocked. */
+    SCHED_EV_YIELD,     /* FROM was switched out, still ready, for TO. */
+    SCHED_EV_SLEEP,     /* FROM was switched out, blocked, for TO. */
+    SCHED_EV_EXIT       /* FROM was switched out, dying, for TO. */
+  };
+
+/* Run queue waits of this many ticks or more share the last
+   histogram bucket. */
+#define SCHED_TRACE_WAIT_MAX 256
+
+/* Summary of scheduling events since the last reset. */
+struct sched_trace_stats
+  {
+    unsigned switches;          /* Context switches. */
+    unsigned waits;             /* Number of run queue waits. */
+    uint64_t wait_sum;          /* Sum of waits, in ticks. */
+    unsigned wait_max;          /* Longest wait, in ticks. */
+    unsigned wait_hist[SCHED_TRACE_WAIT_MAX + 1]; /* Waits by length. */
+  };
+
+/* Set by the "-trace" option: dump the trace at shutdown. */
+extern bool sched_trace_enabled;
+
+void sched_trace_record (enum sched_event_type,
+                         struct thread *from, struct thread *to);
+void sched_trace_dump (void);
+
+void sched_trace_reset_stats (void);
+void sched_trace_get_stats (struct sched_trace_stats *);
+unsigned sched_trace_wait_percentile (const struct sched_trace_stats *,
+                                      unsigned percent);
+
+#endif /* threads/sched-trace.h */
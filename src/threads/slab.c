@@ -0,0 +1,276 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Slab allocator for fixed-size objects.
+
+   malloc() rounds each request up to a power of 2, which wastes
+   up to half of every block, e.g. a 540-byte object occupies a
+   1 kB block.  A slab cache instead serves objects of a single
+   size, packed as tightly as their alignment allows.
+
+   The cache obtains memory a page at a time from the page
+   allocator.  Each page, called a "slab", begins with a struct
+   slab header, followed by an array with one free list link per
+   object, followed by the objects themselves.  Keeping the links
+   outside the objects means that a free object keeps whatever
+   state the cache's constructor gave it, so that the constructor
+   runs only when a slab is created, not on every allocation.
+
+   Each slab is on one of three lists, according to whether all,
+   some, or none of its objects are free.  Allocations are served
+   from partially used slabs first, to keep the number of slabs
+   down.  A cache keeps at most SLAB_EMPTY_MAX completely free
+   slabs around; slab_shrink() gives even those back. */
+
+/* Maximum number of empty slabs kept by a cache. */
+#define SLAB_EMPTY_MAX 1
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Marks the end of a slab's free list. */
+#define SLAB_NONE 0xffff
+
+/* Slab header, at the start of a slab's page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct slab_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in one of the cache's lists. */
+    size_t free_cnt;            /* Number of free objects. */
+    uint16_t free_head;         /* First free object, or SLAB_NONE. */
+    uint16_t next[];            /* Free list links, one per object. */
+  };
+
+static struct slab *object_to_slab (struct slab_cache *, void *);
+static void *slab_object (struct slab *, size_t idx);
+static struct slab *slab_create (struct slab_cache *);
+static void slab_destroy (struct slab_cache *, struct slab *);
+
+/* Initializes CACHE to hold objects of SIZE bytes each, aligned
+   on ALIGN-byte boundaries, which must be a power of 2.  If CTOR
+   is nonnull, it is called on each object when it is first added
+   to the cache.  NAME is used only for debugging. */
+void
+slab_cache_init (struct slab_cache *cache, const char *name,
+                 size_t size, size_t align, slab_ctor_func *ctor)
+{
+  size_t obj_cnt;
+
+  ASSERT (cache != NULL);
+  ASSERT (size > 0);
+  ASSERT (align > 0 && (align & (align - 1)) == 0);
+
+  cache->name = name;
+  cache->obj_size = ROUND_UP (size, align);
+
+  /* Fit as many objects as possible after the header. */
+  obj_cnt = (PGSIZE - sizeof (struct slab)) / (cache->obj_size
+                                                + sizeof (uint16_t));
+  if (obj_cnt > SLAB_NONE)
+    obj_cnt = SLAB_NONE;
+  while (obj_cnt > 0
+         && (ROUND_UP (sizeof (struct slab) + obj_cnt * sizeof (uint16_t),
+                       align)
+             + obj_cnt * cache->obj_size) > PGSIZE)
+    obj_cnt--;
+  if (obj_cnt == 0)
+    PANIC ("%s: %zu-byte objects are too big for a slab", name, size);
+  cache->obj_cnt = obj_cnt;
+  cache->obj_ofs = ROUND_UP (sizeof (struct slab)
+                             + obj_cnt * sizeof (uint16_t), align);
+
+  cache->ctor = ctor;
+  list_init (&cache->partial);
+  list_init (&cache->full);
+  list_init (&cache->empty);
+  cache->empty_cnt = 0;
+  lock_init (&cache->lock);
+}
+
+/* Obtains and returns an object from CACHE.  The object is in the
+   state left by the cache's constructor, if any, or by its last
+   user.  Returns a null pointer if memory is not available. */
+void *
+slab_alloc (struct slab_cache *cache)
+{
+  struct slab *s;
+  void *object;
+
+  lock_acquire (&cache->lock);
+
+  /* Prefer a partially used slab, then an empty one, then a new
+     one. */
+  if (!list_empty (&cache->partial))
+    s = list_entry (list_front (&cache->partial), struct slab, elem);
+  else if (!list_empty (&cache->empty))
+    {
+      s = list_entry (list_pop_front (&cache->empty), struct slab, elem);
+      cache->empty_cnt--;
+      list_push_front (&cache->partial, &s->elem);
+    }
+  else
+    {
+      s = slab_create (cache);
+      if (s == NULL)
+        {
+          lock_release (&cache->lock);
+          return NULL;
+        }
+      list_push_front (&cache->partial, &s->elem);
+    }
+
+  /* Take the first free object. */
+  ASSERT (s->free_head != SLAB_NONE);
+  object = slab_object (s, s->free_head);
+  s->free_head = s->next[s->free_head];
+  if (--s->free_cnt == 0)
+    {
+      list_remove (&s->elem);
+      list_push_front (&cache->full, &s->elem);
+    }
+
+  lock_release (&cache->lock);
+  return object;
+}
+
+/* Returns OBJECT, which must have been obtained from CACHE with
+   slab_alloc(), to CACHE.  If CACHE has a constructor, OBJECT
+   should be in its constructed state. */
+void
+slab_free (struct slab_cache *cache, void *object)
+{
+  struct slab *s;
+  size_t idx;
+
+  if (object == NULL)
+    return;
+
+  s = object_to_slab (cache, object);
+  idx = ((uint8_t *) object - (uint8_t *) slab_object (s, 0))
+        / cache->obj_size;
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs, unless
+     that would destroy its constructed state. */
+  if (cache->ctor == NULL)
+    memset (object, 0xcc, cache->obj_size);
+#endif
+
+  lock_acquire (&cache->lock);
+
+  s->next[idx] = s->free_head;
+  s->free_head = idx;
+  s->free_cnt++;
+  if (s->free_cnt == 1)
+    {
+      /* The slab was full. */
+      list_remove (&s->elem);
+      list_push_front (&cache->partial, &s->elem);
+    }
+  if (s->free_cnt == cache->obj_cnt)
+    {
+      /* The slab is now empty.  Keep it unless we have enough
+         empty slabs already. */
+      list_remove (&s->elem);
+      if (cache->empty_cnt < SLAB_EMPTY_MAX)
+        {
+          list_push_front (&cache->empty, &s->elem);
+          cache->empty_cnt++;
+        }
+      else
+        slab_destroy (cache, s);
+    }
+
+  lock_release (&cache->lock);
+}
+
+/* Gives all of CACHE's empty slabs back to the page allocator and
+   returns the number of pages freed. */
+size_t
+slab_shrink (struct slab_cache *cache)
+{
+  size_t freed = 0;
+
+  lock_acquire (&cache->lock);
+  while (!list_empty (&cache->empty))
+    {
+      struct slab *s = list_entry (list_pop_front (&cache->empty),
+                                   struct slab, elem);
+      slab_destroy (cache, s);
+      freed++;
+    }
+  cache->empty_cnt = 0;
+  lock_release (&cache->lock);
+
+  return freed;
+}
+
+/* Returns the slab in CACHE that OBJECT is inside. */
+static struct slab *
+object_to_slab (struct slab_cache *cache UNUSED, void *object)
+{
+  struct slab *s = pg_round_down (object);
+
+  /* Check that the slab is valid. */
+  ASSERT (s != NULL);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == cache);
+
+  /* Check that the object is properly aligned for the slab. */
+  ASSERT (pg_ofs (object) >= cache->obj_ofs);
+  ASSERT ((pg_ofs (object) - cache->obj_ofs) % cache->obj_size == 0);
+
+  return s;
+}
+
+/* Returns the IDX'th object within slab S. */
+static void *
+slab_object (struct slab *s, size_t idx)
+{
+  ASSERT (idx < s->cache->obj_cnt);
+  return (uint8_t *) s + s->cache->obj_ofs + idx * s->cache->obj_size;
+}
+
+/* Creates and returns a new slab for CACHE, with all of its
+   objects free and constructed.  Returns a null pointer if no
+   page is available.  CACHE's lock must be held. */
+static struct slab *
+slab_create (struct slab_cache *cache)
+{
+  struct slab *s;
+  size_t i;
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = cache;
+  s->free_cnt = cache->obj_cnt;
+  s->free_head = 0;
+  for (i = 0; i < cache->obj_cnt; i++)
+    {
+      s->next[i] = i + 1 < cache->obj_cnt ? i + 1 : SLAB_NONE;
+      if (cache->ctor != NULL)
+        cache->ctor (slab_object (s, i));
+    }
+  return s;
+}
+
+/* Gives slab S, which must have no objects in use and must not be
+   on any of CACHE's lists, back to the page allocator.  CACHE's
+   lock must be held. */
+static void
+slab_destroy (struct slab_cache *cache UNUSED, struct slab *s)
+{
+  ASSERT (s->free_cnt == cache->obj_cnt);
+
+  s->magic = 0;
+  palloc_free_page (s);
+}
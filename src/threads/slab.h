@@ -0,0 +1,33 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Constructor for the objects in a slab cache.  Called once on
+   each object when the page holding it is added to the cache. */
+typedef void slab_ctor_func (void *object);
+
+/* A cache of fixed-size objects.  See slab.c for details. */
+struct slab_cache
+  {
+    const char *name;           /* Name, for debugging. */
+    size_t obj_size;            /* Object size, rounded up to alignment. */
+    size_t obj_cnt;             /* Objects per slab. */
+    size_t obj_ofs;             /* Offset of first object in a slab. */
+    slab_ctor_func *ctor;       /* Object constructor, or null. */
+    struct list partial;        /* Slabs with free and used objects. */
+    struct list full;           /* Slabs with no free objects. */
+    struct list empty;          /* Slabs with no used objects. */
+    size_t empty_cnt;           /* Number of slabs in `empty'. */
+    struct lock lock;           /* Mutual exclusion. */
+  };
+
+void slab_cache_init (struct slab_cache *, const char *name,
+                      size_t size, size_t align, slab_ctor_func *);
+void *slab_alloc (struct slab_cache *);
+void slab_free (struct slab_cache *, void *);
+size_t slab_shrink (struct slab_cache *);
+
+#endif /* threads/slab.h */
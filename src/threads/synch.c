@@ -185,6 +185,7 @@ lock_init (struct lock *lock)
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+  rb_init (&lock->donors, thread_donor_cmp, NULL);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -208,14 +209,15 @@ lock_acquire (struct lock *lock)
   old_level = intr_disable();
 
   if (lock->holder != NULL)
-  {
-    thread_current()->waiting_on = lock;
-    thread_donate_priority(thread_current());
-  }
+    thread_make_donation(thread_current(), lock);
 
   sema_down (&lock->semaphore);
+  thread_recall_donation(thread_current());
   lock->holder = thread_current ();
-  thread_current()->waiting_on = NULL;
+  list_push_back(&thread_current()->held_locks, &lock->elem);
+
+  /* The remaining waiters now donate to us. */
+  thread_calculate_priority(thread_current());
   intr_set_level(old_level);
 }
 
@@ -233,14 +235,25 @@ lock_try_acquire (struct lock *lock)
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  enum intr_level old_level = intr_disable();
   success = sema_try_down (&lock->semaphore);
   if (success)
+  {
     lock->holder = thread_current ();
+    list_push_back(&thread_current()->held_locks, &lock->elem);
+    thread_calculate_priority(thread_current());
+  }
+  intr_set_level(old_level);
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
 
+   The lock's waiters stop donating to us, and the top donor is
+   woken up directly, without scanning the semaphore's waiters.
+   If the top donor has already been woken up but has not run yet,
+   it will take the lock when it does.
+
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
    handler. */
@@ -251,20 +264,23 @@ lock_release (struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
 
   enum intr_level old_level = intr_disable();
+  list_remove(&lock->elem);
   lock->holder = NULL;
+  thread_calculate_priority(thread_current());
 
-  struct list_elem *e;
-  for (e = list_begin(&lock->semaphore.waiters); e != list_end (&lock->semaphore.waiters); e = list_next(e))
+  if (!rb_empty(&lock->donors))
   {
-    struct thread *t = list_entry(e, struct thread, elem);
-    thread_recall_donation(t);
+    struct thread *top = rb_entry(rb_min(&lock->donors), struct thread, donor_node);
+    if (top->status == THREAD_BLOCKED)
+    {
+      list_remove(&top->elem);
+      thread_unblock(top);
+    }
   }
-  thread_calculate_priority(thread_current());
-
-  lock->holder = NULL;
-
-  sema_up (&lock->semaphore);
+  lock->semaphore.value++;
   intr_set_level(old_level);
+
+  thread_yield_to_max();
 }
 
 /* Returns true if the current thread holds LOCK, false
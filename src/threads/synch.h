@@ -2,6 +2,7 @@
 #define THREADS_SYNCH_H
 
 #include <list.h>
+#include <rbtree.h>
 #include <stdbool.h>
 
 /* A counting semaphore. */
@@ -22,6 +23,8 @@ struct lock
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's held_locks. */
+    struct rb_tree donors;      /* Waiters, by donated priority. */
   };
 
 void lock_init (struct lock *);
@@ -4,10 +4,13 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/sched-trace.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -20,9 +23,26 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Number of levels in a run queue, one per priority. */
+#define RUNQUEUE_LEVELS (PRI_MAX - PRI_MIN + 1)
+
+/* A run queue: one FIFO list per level plus a bitmap of the
+   non-empty levels, so that insertion, removal and finding the
+   highest occupied level are all O(1). */
+struct runqueue
+  {
+    struct list levels[RUNQUEUE_LEVELS]; /* One FIFO per level. */
+    uint64_t occupied;                  /* Bit L set if levels[L] nonempty. */
+    size_t size;                        /* Number of queued threads. */
+  };
+
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running, queued by priority. */
+static struct runqueue ready_queue;
+
+/* Number of processes in THREAD_READY state, whichever structure
+   the selected scheduler keeps them in. */
+static size_t ready_threads;
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -31,6 +51,22 @@ static struct list all_list;
 /* Idle thread. */
 static struct thread *idle_thread;
 
+/* Pages of threads that have exited, in THREAD_DYING state.
+   thread_schedule_tail() queues them here instead of freeing them
+   with interrupts off, thread_create() reuses them before asking
+   palloc for a new page, and the reaper thread returns the excess
+   over THREAD_PAGE_CACHE to palloc in batches of REAPER_BATCH.
+   Only accessed with interrupts off. */
+#define THREAD_PAGE_CACHE 16
+#define REAPER_BATCH 8
+static struct list zombie_list;
+static size_t zombie_cnt;
+
+/* Reaper thread, and whether it is waiting for work, as opposed
+   to freeing pages (which may block on palloc's lock). */
+static struct thread *reaper_thread;
+static bool reaper_waiting;
+
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
@@ -53,6 +89,66 @@ static long long user_ticks;    /* # of timer ticks in user programs. */
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+static unsigned time_slice = TIME_SLICE; /* # of timer ticks for the
+                                           running thread. */
+
+/* Simple CFS.  Virtual run time advances by
+   CFS_NICE_0_WEIGHT / weight units of CFS_NICE_0_WEIGHT per tick,
+   so a thread of default priority accrues CFS_NICE_0_WEIGHT per
+   tick and heavier threads accrue proportionally less. */
+#define CFS_NICE_0_WEIGHT 1024  /* Weight of a PRI_DEFAULT thread. */
+#define CFS_LATENCY 20          /* Target period, in ticks, to run
+                                   every ready thread once. */
+#define CFS_MIN_GRANULARITY 1   /* Minimum time slice, in ticks. */
+#define CFS_WAKEUP_GRANULARITY CFS_NICE_0_WEIGHT
+                                /* Vruntime lead a ready thread needs
+                                   to preempt the running one. */
+static struct rb_tree cfs_tree;         /* Ready threads by vruntime. */
+static int64_t cfs_min_vruntime;        /* Monotonic minimum vruntime. */
+static int cfs_load;                    /* Sum of weights in cfs_tree. */
+
+/* Lottery.  Ready threads occupy slots of a Fenwick tree over
+   their ticket counts, so that drawing a winner and adding or
+   removing a thread are all O(log LOTTERY_SLOTS).  Threads that
+   become ready while every slot is taken wait in lottery_overflow,
+   in FIFO order, and enter the draw as slots are freed. */
+#define LOTTERY_SLOTS 1024      /* Number of threads in the draw. */
+static struct thread *lottery_slots[LOTTERY_SLOTS]; /* Slot owners. */
+static int lottery_free[LOTTERY_SLOTS]; /* Stack of free slots. */
+static int lottery_free_cnt;            /* Entries in lottery_free. */
+static int lottery_fenwick[LOTTERY_SLOTS + 1]; /* 1-based Fenwick tree. */
+static int lottery_total;               /* Tickets in the draw. */
+static struct list lottery_overflow;    /* Ready threads without a slot. */
+
+/* MLFQS.  Priorities are recomputed from recent_cpu and nice
+   every MLFQS_PRIORITY_TICKS ticks for the running thread, whose
+   recent_cpu is the only one that changes in between, and once a
+   second for every thread, together with load_avg. */
+#define MLFQS_PRIORITY_TICKS 4
+static fixed_t load_avg;        /* System load average. */
+
+/* Dual queue and N queues.  Queue K is kept at level
+   RUNQUEUE_LEVELS - 1 - K of ready_queue, so that the highest
+   occupied level is the topmost nonempty queue. */
+#define MQ_MAX_QUANTUM 64       /* Cap on any queue's quantum, in ticks. */
+int queue_quantum = TIME_SLICE;
+static int mq_count;            /* Number of queues in use. */
+static unsigned mq_quantum[RUNQUEUE_LEVELS]; /* Quantum of each queue. */
+
+/* Load weight of each priority.  Each priority level weighs
+   about 10% more than the one below it, and PRI_DEFAULT weighs
+   CFS_NICE_0_WEIGHT. */
+static const int cfs_prio_to_weight[PRI_MAX - PRI_MIN + 1] =
+  {
+       53,    59,    65,    71,    78,    86,    95,   104,
+      114,   126,   138,   152,   167,   184,   203,   223,
+      245,   270,   297,   326,   359,   395,   434,   478,
+      525,   578,   636,   699,   769,   846,   931,  1024,
+     1126,  1239,  1363,  1499,  1649,  1814,  1995,  2195,
+     2415,  2656,  2922,  3214,  3535,  3889,  4278,  4705,
+     5176,  5693,  6263,  6889,  7578,  8336,  9169, 10086,
+    11095, 12204, 13425, 14767, 16244, 17868, 19655, 21621,
+  };
 
 /* This selects the used scheduling algorithm.
  * 'Hot Swapping' function is not required and also not expected.
@@ -65,9 +161,39 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 enum scheduling_algorithm selected_scheduler = SCH_PRIORITIZED;
 next_thread_function next_thread_to_run_function;
 
+/* Run queue operations of the selected scheduler.  They default
+   to the priority run queue and are overridden by
+   pick_scheduler() for schedulers that keep their own
+   structures. */
+typedef void ready_action_func (struct thread *);
+typedef bool preempt_func (void);
+typedef unsigned time_slice_func (struct thread *);
+
+static ready_action_func prio_ready_push;
+static ready_action_func prio_ready_update;
+static preempt_func prio_should_preempt;
+static time_slice_func fixed_time_slice;
+
+/* Adds a thread to the run queue. */
+static ready_action_func *ready_push_function = prio_ready_push;
+/* Requeues a ready thread after its priority changed. */
+static ready_action_func *ready_update_function = prio_ready_update;
+/* Returns true if the running thread should give up the CPU to
+   some ready thread. */
+static preempt_func *should_preempt_function = prio_should_preempt;
+/* Accounts a timer tick to the running thread, or null. */
+static ready_action_func *tick_function = NULL;
+/* Called when the running thread uses up its time slice, or
+   null. */
+static ready_action_func *quantum_expired_function = NULL;
+/* Returns the number of ticks the given thread may run. */
+static time_slice_func *time_slice_function = fixed_time_slice;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
+static void reaper (void *aux UNUSED);
+static struct thread *alloc_thread_page (void);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
@@ -76,6 +202,28 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void runqueue_init (struct runqueue *);
+static void runqueue_push (struct runqueue *, struct thread *, int level);
+static void runqueue_remove (struct runqueue *, struct thread *);
+static struct thread *runqueue_pop_max (struct runqueue *);
+static int runqueue_max_level (const struct runqueue *);
+static void ready_push (struct thread *);
+static void mlfqs_update_priority (struct thread *);
+static rb_less_func cfs_vruntime_less;
+static ready_action_func cfs_ready_push, cfs_ready_remove;
+static ready_action_func cfs_ready_update, cfs_tick;
+static preempt_func cfs_should_preempt;
+static time_slice_func cfs_time_slice;
+static void lottery_init (void);
+static ready_action_func lottery_ready_push, dyn_lottery_ready_push;
+static ready_action_func lottery_ready_remove;
+static ready_action_func lottery_ready_update, dyn_lottery_ready_update;
+static preempt_func lottery_should_preempt;
+static ready_action_func mlfqs_tick;
+static void mq_init (int count);
+static ready_action_func mq_ready_push, mq_ready_update, mq_demote;
+static preempt_func mq_should_preempt;
+static time_slice_func mq_time_slice;
 
 
 /* Initializes the threading system by transforming the code
@@ -97,8 +245,11 @@ thread_init (void)
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  runqueue_init (&ready_queue);
+  rb_init (&cfs_tree, cfs_vruntime_less, NULL);
+  lottery_init ();
   list_init (&all_list);
+  list_init (&zombie_list);
 
   pick_scheduler();
 
@@ -127,6 +278,9 @@ thread_start (void)
   /* Wait for the idle thread to initialize idle_thread. */
   sema_down (&idle_started);
 
+  /* Create the thread that frees the pages of dead threads. */
+  thread_create ("reaper", PRI_MIN, reaper, NULL);
+
   context_changes = 0;
   process_count = 1;
   ready_waiting_total = 0;
@@ -153,10 +307,15 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (tick_function != NULL)
+    tick_function (t);
+
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (++thread_ticks >= time_slice)
   {
     t->quantum_run_out_times++;
+    if (quantum_expired_function != NULL)
+      quantum_expired_function (t);
     intr_yield_on_return ();
   }
 
@@ -202,7 +361,7 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = alloc_thread_page ();
   if (t == NULL)
     return TID_ERROR;
 
@@ -210,6 +369,15 @@ thread_create (const char *name, int priority,
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
 
+  /* Under MLFQS, the new thread inherits its parent's niceness and
+     recent CPU use, and its priority derives from them. */
+  if (selected_scheduler == SCH_MLFQS)
+    {
+      t->nice = thread_current ()->nice;
+      t->recent_cpu = thread_current ()->recent_cpu;
+      mlfqs_update_priority (t);
+    }
+
   // ????
   old_level = intr_disable();
 
@@ -262,6 +430,7 @@ thread_block (void)
   ASSERT (intr_get_level () == INTR_OFF);
   thread_current ()->blocked_times++;
   thread_current ()->status = THREAD_BLOCKED;
+  sched_trace_record (SCHED_EV_BLOCK, thread_current (), NULL);
 
   schedule ();
 }
@@ -285,28 +454,33 @@ thread_max_priority (void)
   old_level = intr_disable ();
   int return_value = -1;
 
-  if (list_begin (&ready_list) != list_end (&ready_list))
-    {
-      /* Race condition exists here if interrupts are not disabled:
-         if there is only one other thread ready and that thread
-         interleaves here, then blocks, then the ready list will
-         be empty when we run again, even though we think it's got
-         something in it, and will end up reading bogus memory below */
-      struct thread *t = list_entry (list_begin (&ready_list),
-                                     struct thread, elem);
-      return_value = t->priority;
-    }
+  /* Race condition exists here if interrupts are not disabled:
+     if there is only one other thread ready and that thread
+     interleaves here, then blocks, then the run queue will be
+     empty when we run again, even though we think it's got
+     something in it. */
+  return_value = runqueue_max_level (&ready_queue);
 
   intr_set_level (old_level);
   return return_value;
 }
 
-/* Check to see if we're one of the highest-priority threads.
-   If not, yield. */
+/* Check to see if the selected scheduler would rather run some
+   ready thread than us (for the priority schedulers, if we are
+   not one of the highest-priority threads).  If so, yield, or
+   in an interrupt handler, yield on return from it. */
 void
 thread_yield_to_max (void)
 {
-  if (thread_max_priority () > thread_get_priority ())
+  enum intr_level old_level = intr_disable ();
+  bool preempt = should_preempt_function ();
+  intr_set_level (old_level);
+
+  if (!preempt)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else
     thread_yield ();
 }
 
@@ -327,9 +501,9 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  // list_push_back (&ready_list, &t->elem);
-  list_insert_ordered(&ready_list, &t->elem, thread_priority_cmp, NULL);
+  ready_push (t);
   t->status = THREAD_READY;
+  sched_trace_record (SCHED_EV_UNBLOCK, running_thread (), t);
   intr_set_level (old_level);
 }
 
@@ -427,8 +601,7 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread)
-    // list_push_back (&ready_list, &cur->elem);
-    list_insert_ordered(&ready_list, &cur->elem, thread_priority_cmp, NULL);
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -452,34 +625,42 @@ thread_foreach (thread_action_func *func, void *aux)
 }
 
 
-/* Return the maximum donated priority of a thread */
+/* Return the maximum donated priority of a thread: the priority
+   of the top donor of each lock it holds.  MLFQS does not use
+   priority donation. */
 static int thread_get_donated_priority(struct thread *t)
 {
   ASSERT(is_thread(t));
+  ASSERT(intr_get_level() == INTR_OFF);
 
-  // ????
-  enum intr_level old_level = intr_disable();
   int return_value = -1;
+  struct list_elem *e;
+
+  if (selected_scheduler == SCH_MLFQS)
+    return return_value;
 
-  if (list_begin(&t->priority_donations) != list_end(&t->priority_donations))
+  for (e = list_begin(&t->held_locks); e != list_end(&t->held_locks); e = list_next(e))
   {
-    struct thread *top = list_entry(list_begin(&t->priority_donations), struct thread, donation_elem);
-    return_value = top->priority;
+    struct lock *lock = list_entry(e, struct lock, elem);
+    if (!rb_empty(&lock->donors))
+    {
+      struct thread *top = rb_entry(rb_min(&lock->donors), struct thread, donor_node);
+      if (top->donor_priority > return_value)
+        return_value = top->donor_priority;
+    }
   }
 
-  // ????
-  intr_set_level(old_level);
   return return_value;
 }
 
-/* Removes a thread, and re-inserts it back, so te ready list maintains ordered */
+/* Lets the scheduler requeue a ready thread whose priority has
+   changed */
 static void thread_reinsert_ready_list(struct thread *t)
 {
   if (t->status == THREAD_READY)
   {
     ASSERT(intr_get_level() == INTR_OFF);
-    list_remove(&t->elem);
-    list_insert_ordered(&ready_list, &t->elem, thread_priority_cmp, NULL);
+    ready_update_function (t);
   }
 }
 
@@ -505,10 +686,14 @@ void thread_calculate_priority(struct thread *t)
   intr_set_level(old_level);
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's priority to NEW_PRIORITY.  Ignored
+   under MLFQS, which computes priorities itself. */
 void
 thread_set_priority (int new_priority)
 {
+  if (selected_scheduler == SCH_MLFQS)
+    return;
+
   thread_current ()->base_priority = new_priority;
   thread_calculate_priority(thread_current());
   thread_yield_to_max ();
@@ -521,103 +706,198 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Donation compare function for list donation */
-static bool
-thread_donation_cmp (const struct list_elem *a,
-                     const struct list_elem *b,
-                     void *aux UNUSED)
+/* Orders the donors of a lock by descending donated priority,
+   first come first served among equals */
+bool
+thread_donor_cmp (const struct rb_node *a, const struct rb_node *b,
+                  void *aux UNUSED)
 {
-  return list_entry (a, struct thread, donation_elem)->priority >
-         list_entry (b, struct thread, donation_elem)->priority;
+  return rb_entry (a, struct thread, donor_node)->donor_priority >
+         rb_entry (b, struct thread, donor_node)->donor_priority;
 }
 
-/* Recompute the priority of thread, and donate if necesary. recurssion */
+/* Donates the priority of thread, which must be waiting on a lock,
+   to the holder of that lock, and on along the chain of holders
+   that are themselves waiting, for at most DONATION_MAX_DEPTH
+   locks.  Each step repositions the donor in its lock's donors
+   tree and recomputes the holder's priority, so the cost does not
+   depend on how many threads wait on each lock.  The chain stops
+   as soon as a holder's priority does not change. */
 void thread_donate_priority (struct thread *t)
 {
-  while (true)
-  {
-    ASSERT(intr_get_level() == INTR_OFF);
-    ASSERT(is_thread(t));
-
-    /* Recalculate our priority */
-    thread_calculate_priority(t);
+  int depth;
 
-    if (t->waiting_on != NULL)
-    {
-      struct thread *waiter = t->waiting_on->holder;
-      ASSERT(waiter != t);
+  ASSERT(intr_get_level() == INTR_OFF);
 
-      if (thread_current() != t)
-        thread_recall_donation(t);
+  if (selected_scheduler == SCH_MLFQS)
+    return;
 
-      if (waiter != NULL)
-      {
-        thread_calculate_priority(waiter);
-        ASSERT(is_thread(waiter));
+  for (depth = 0; depth < DONATION_MAX_DEPTH && t->waiting_on != NULL; depth++)
+  {
+    struct lock *lock = t->waiting_on;
+    struct thread *holder = lock->holder;
+    int old_priority;
 
-        /* Make donation */
-        list_insert_ordered(&waiter->priority_donations, &t->donation_elem, thread_donation_cmp, NULL);
+    ASSERT(is_thread(t));
+    ASSERT(holder != t);
 
-        t = waiter;
-      }
-      else
-      {
-        break;
-      }
-    }
-    else
+    /* Make donation at our current priority */
+    if (t->donor_priority != t->priority)
     {
-      break;
+      rb_remove(&lock->donors, &t->donor_node);
+      t->donor_priority = t->priority;
+      rb_insert(&lock->donors, &t->donor_node);
     }
+
+    if (holder == NULL)
+      break;
+
+    old_priority = holder->priority;
+    thread_calculate_priority(holder);
+    if (holder->priority == old_priority)
+      break;
+
+    t = holder;
   }
 }
 
-/* Remove the given thread donation, assumes that it has already made a donation, and the donor doesn't need to recompute effective priority */
+/* Enters thread, which is about to wait on LOCK, as a donor of
+   LOCK and donates its priority along the chain of holders. */
+void thread_make_donation (struct thread *t, struct lock *lock)
+{
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(t->waiting_on == NULL);
+
+  t->waiting_on = lock;
+  t->donor_priority = t->priority;
+  rb_insert(&lock->donors, &t->donor_node);
+  thread_donate_priority(t);
+}
+
+/* Withdraws the donation of thread, which stopped waiting on its
+   lock.  The lock's holder, if any, does not recompute its
+   priority here. */
 void thread_recall_donation (struct thread *t)
 {
     ASSERT(intr_get_level() == INTR_OFF);
     ASSERT(is_thread(t));
 
-    /* Make sure to have made a donation */
-    if (t->donation_elem.next != NULL)
+    if (t->waiting_on != NULL)
     {
-      list_remove(&t->donation_elem);
-      t->donation_elem.next = NULL;
+      rb_remove(&t->waiting_on->donors, &t->donor_node);
+      t->waiting_on = NULL;
     }
-
 }
 
 
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it is no longer the highest. */
 void
-thread_set_nice (int nice UNUSED)
+thread_set_nice (int nice)
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (selected_scheduler == SCH_MLFQS)
+    mlfqs_update_priority (cur);
+  intr_set_level (old_level);
+
+  thread_yield_to_max ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int value = fix_round (fix_mul_int (load_avg, 100));
+  intr_set_level (old_level);
+  return value;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int value = fix_round (fix_mul_int (thread_current ()->recent_cpu, 100));
+  intr_set_level (old_level);
+  return value;
+}
+
+/* Sets T's priority to PRI_MAX - recent_cpu / 4 - nice * 2,
+   clamped to the valid range, and requeues T if it is ready. */
+static void
+mlfqs_update_priority (struct thread *t)
+{
+  int priority = PRI_MAX - fix_trunc (fix_div_int (t->recent_cpu, 4))
+                 - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+
+  t->base_priority = t->priority = priority;
+  if (t->status == THREAD_READY)
+    ready_update_function (t);
+}
+
+/* Decays T's recent_cpu by the load average and recomputes its
+   priority.  Called once a second for every thread. */
+static void
+mlfqs_update_thread (struct thread *t, void *aux UNUSED)
+{
+  fixed_t twice_load = fix_mul_int (load_avg, 2);
+
+  if (t == idle_thread)
+    return;
+
+  t->recent_cpu = fix_add_int (fix_mul (fix_div (twice_load,
+                                                 fix_add_int (twice_load, 1)),
+                                        t->recent_cpu),
+                               t->nice);
+  mlfqs_update_priority (t);
+}
+
+/* Accounts a tick to the running thread T under MLFQS and
+   performs the periodic recomputations.  Only T's recent_cpu
+   changes between whole seconds, so only its priority is
+   recomputed every MLFQS_PRIORITY_TICKS; everything else is
+   refreshed once a second. */
+static void
+mlfqs_tick (struct thread *t)
+{
+  int64_t ticks = timer_ticks ();
+
+  if (t != idle_thread)
+    t->recent_cpu = fix_add_int (t->recent_cpu, 1);
+
+  if (ticks % TIMER_FREQ == 0)
+    {
+      int ready = ready_threads + (t != idle_thread ? 1 : 0);
+
+      load_avg = fix_add (fix_mul (fix_div_int (fix_int (59), 60), load_avg),
+                          fix_mul_int (fix_div_int (fix_int (1), 60), ready));
+      thread_foreach (mlfqs_update_thread, NULL);
+    }
+  else if (ticks % MLFQS_PRIORITY_TICKS == 0 && t != idle_thread)
+    mlfqs_update_priority (t);
+
+  if (prio_should_preempt ())
+    intr_yield_on_return ();
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -638,6 +918,12 @@ idle (void *idle_started_ UNUSED)
 
   for (;;)
     {
+      /* Use idle time to zero pages for palloc_get_page(), until
+         there is nothing left to zero or another thread becomes
+         ready. */
+      while (ready_threads == 0 && palloc_zero_idle ())
+        continue;
+
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
@@ -658,6 +944,62 @@ idle (void *idle_started_ UNUSED)
     }
 }
 
+/* Reaper thread.  Sleeps until more than THREAD_PAGE_CACHE dead
+   threads are waiting in zombie_list, then frees the excess pages
+   in batches.  It runs at PRI_MIN, so that freeing pages stays off
+   the thread switch path and out of the way of real work. */
+static void
+reaper (void *aux UNUSED)
+{
+  reaper_thread = thread_current ();
+
+  for (;;)
+    {
+      struct list batch;
+      int i;
+
+      intr_disable ();
+      while (zombie_cnt <= THREAD_PAGE_CACHE)
+        {
+          reaper_waiting = true;
+          thread_block ();
+          reaper_waiting = false;
+        }
+
+      list_init (&batch);
+      for (i = 0; i < REAPER_BATCH && zombie_cnt > THREAD_PAGE_CACHE; i++)
+        {
+          list_push_back (&batch, list_pop_front (&zombie_list));
+          zombie_cnt--;
+        }
+      intr_enable ();
+
+      while (!list_empty (&batch))
+        palloc_free_page (list_entry (list_pop_front (&batch),
+                                      struct thread, elem));
+    }
+}
+
+/* Returns a page for a new thread: the page of a dead thread if
+   any is waiting to be reaped, otherwise a fresh page from palloc.
+   The caller must initialize the `struct thread' at its start,
+   since a recycled page is not zeroed. */
+static struct thread *
+alloc_thread_page (void)
+{
+  struct thread *t = NULL;
+  enum intr_level old_level = intr_disable ();
+
+  if (!list_empty (&zombie_list))
+    {
+      t = list_entry (list_pop_front (&zombie_list), struct thread, elem);
+      zombie_cnt--;
+    }
+  intr_set_level (old_level);
+
+  return t != NULL ? t : palloc_get_page (PAL_ZERO);
+}
+
 /* Function used as the basis for a kernel thread. */
 static void
 kernel_thread (thread_func *function, void *aux)
@@ -712,7 +1054,13 @@ init_thread (struct thread *t, const char *name, int priority)
   t->magic = THREAD_MAGIC;
   // ????
   //old_level = intr_disable ();
-  list_init (&t->priority_donations);
+  t->vruntime = cfs_min_vruntime;
+  list_init (&t->held_locks);
+#ifdef USERPROG
+  t->user_process = false;
+  t->exit_status = -1;
+  list_init (&t->children);
+#endif
   list_push_back (&all_list, &t->allelem);
   //list_insert_ordered(&all_list, &t->allelem, &cmp_thread_priority, NULL);
 
@@ -739,25 +1087,18 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run_fcfs (void)
 {
-  return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  return runqueue_pop_max (&ready_queue);
 }
 
-/** Multi-level feedback queue scheduler */
+/** Multi-level feedback queue scheduler
+ *
+ * The 4.4BSD scheduler: one queue per priority, round robin
+ * within each, with priorities computed by mlfqs_tick().
+ */
 static struct thread *
 next_thread_to_run_mlfqs (void)
 {
-  //unimplemented, just for completeness
-  return list_entry (list_pop_front (&ready_list), struct thread, elem);
-}
-
-bool most_pri (const struct list_elem *a,
-               const struct list_elem *b,
-               void *aux) {
-  struct thread *ta = list_entry (a, struct thread, elem);
-  struct thread *tb = list_entry (b, struct thread, elem);
-  ASSERT (is_thread (ta));
-  ASSERT (is_thread (tb));
-  return ta->priority > tb->priority;
+  return runqueue_pop_max (&ready_queue);
 }
 
 /** Prioritized Scheduling
@@ -768,50 +1109,417 @@ bool most_pri (const struct list_elem *a,
 static struct thread *
 next_thread_to_run_prioritized (void)
 {
-  list_sort (&ready_list, &most_pri, NULL);
-  return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  return runqueue_pop_max (&ready_queue);
+}
+
+/* Orders threads in cfs_tree by ascending virtual run time. */
+static bool
+cfs_vruntime_less (const struct rb_node *a, const struct rb_node *b,
+                   void *aux UNUSED)
+{
+  return rb_entry (a, struct thread, cfs_node)->vruntime
+         < rb_entry (b, struct thread, cfs_node)->vruntime;
+}
+
+/* Advances cfs_min_vruntime to the smallest vruntime among the
+   running thread CUR and the ready threads.  It never moves
+   backwards, so it is a safe floor for new and waking threads. */
+static void
+cfs_update_min_vruntime (struct thread *cur)
+{
+  int64_t vruntime = cur->vruntime;
+
+  if (!rb_empty (&cfs_tree))
+    {
+      struct thread *first = rb_entry (rb_min (&cfs_tree),
+                                       struct thread, cfs_node);
+      if (first->vruntime < vruntime)
+        vruntime = first->vruntime;
+    }
+  if (vruntime > cfs_min_vruntime)
+    cfs_min_vruntime = vruntime;
 }
 
-/** Simplified implementation of the Completely Fair Scheduler */
+/* Queues T in cfs_tree.  A thread that slept for a long time
+   would otherwise come back with a vruntime far behind everyone
+   else and monopolize the CPU, so it is placed at most half a
+   scheduling period behind cfs_min_vruntime. */
+static void
+cfs_ready_push (struct thread *t)
+{
+  int64_t floor = cfs_min_vruntime
+                  - (int64_t) CFS_LATENCY * CFS_NICE_0_WEIGHT / 2;
+
+  if (t->vruntime < floor)
+    t->vruntime = floor;
+  t->cfs_weight = cfs_prio_to_weight[t->priority];
+  cfs_load += t->cfs_weight;
+  rb_insert (&cfs_tree, &t->cfs_node);
+}
+
+/* Removes ready thread T from cfs_tree. */
+static void
+cfs_ready_remove (struct thread *t)
+{
+  rb_remove (&cfs_tree, &t->cfs_node);
+  cfs_load -= t->cfs_weight;
+}
+
+/* Refreshes the load weight of ready thread T after a priority
+   change.  Its position in cfs_tree does not depend on it. */
+static void
+cfs_ready_update (struct thread *t)
+{
+  int weight = cfs_prio_to_weight[t->priority];
+
+  cfs_load += weight - t->cfs_weight;
+  t->cfs_weight = weight;
+}
+
+/* Charges one tick of weighted virtual run time to the running
+   thread T. */
+static void
+cfs_tick (struct thread *t)
+{
+  if (t == idle_thread)
+    return;
+
+  t->vruntime += CFS_NICE_0_WEIGHT * CFS_NICE_0_WEIGHT
+                 / cfs_prio_to_weight[t->priority];
+  cfs_update_min_vruntime (t);
+}
+
+/* Preempts the running thread when the leftmost ready thread is
+   more than CFS_WAKEUP_GRANULARITY behind it. */
+static bool
+cfs_should_preempt (void)
+{
+  struct thread *cur = running_thread ();
+  struct thread *first;
+
+  if (rb_empty (&cfs_tree))
+    return false;
+  if (cur == idle_thread)
+    return true;
+
+  first = rb_entry (rb_min (&cfs_tree), struct thread, cfs_node);
+  return first->vruntime + CFS_WAKEUP_GRANULARITY < cur->vruntime;
+}
+
+/* Gives T its weighted share of the scheduling period, which is
+   CFS_LATENCY ticks stretched so that every ready thread gets at
+   least CFS_MIN_GRANULARITY. */
+static unsigned
+cfs_time_slice (struct thread *t)
+{
+  int weight = cfs_prio_to_weight[t->priority];
+  int period = CFS_LATENCY;
+  int slice;
+
+  if ((rb_size (&cfs_tree) + 1) * CFS_MIN_GRANULARITY > (size_t) period)
+    period = (rb_size (&cfs_tree) + 1) * CFS_MIN_GRANULARITY;
+
+  slice = period * weight / (cfs_load + weight);
+  return slice > CFS_MIN_GRANULARITY ? slice : CFS_MIN_GRANULARITY;
+}
+
+/** Simplified implementation of the Completely Fair Scheduler
+ *
+ * Runs the ready thread with the smallest weighted virtual run
+ * time, kept in a red-black tree, so selection is O(log n).
+ */
 static struct thread *
 next_thread_to_run_sCFS (void)
 {
-  //OLDTODO: Implement Simple Completely Fair Scheduler
-  return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  struct thread *t = rb_entry (rb_min (&cfs_tree), struct thread, cfs_node);
+
+  cfs_ready_remove (t);
+  cfs_update_min_vruntime (t);
+  return t;
 }
 
-/** Lottery Scheduler */
+/* Marks every lottery slot as free. */
+static void
+lottery_init (void)
+{
+  int slot;
+
+  for (slot = 0; slot < LOTTERY_SLOTS; slot++)
+    lottery_free[slot] = LOTTERY_SLOTS - 1 - slot;
+  lottery_free_cnt = LOTTERY_SLOTS;
+  list_init (&lottery_overflow);
+}
+
+/* Adds DELTA tickets to lottery slot SLOT. */
+static void
+lottery_add (int slot, int delta)
+{
+  int i;
+
+  for (i = slot + 1; i <= LOTTERY_SLOTS; i += i & -i)
+    lottery_fenwick[i] += delta;
+  lottery_total += delta;
+}
+
+/* Returns the slot holding ticket number WINNER, counting
+   tickets from slot 0 upwards, by descending the Fenwick tree. */
+static int
+lottery_find (int winner)
+{
+  int pos = 0;
+  int step;
+
+  ASSERT (0 <= winner && winner < lottery_total);
+
+  for (step = LOTTERY_SLOTS; step > 0; step >>= 1)
+    if (pos + step <= LOTTERY_SLOTS && lottery_fenwick[pos + step] <= winner)
+      {
+        pos += step;
+        winner -= lottery_fenwick[pos];
+      }
+  return pos;
+}
+
+/* Tickets of T under the prioritized lottery: one per priority
+   level, so that a PRI_MAX thread holds 64 times the tickets of a
+   PRI_MIN one. */
+static int
+lottery_tickets (struct thread *t)
+{
+  return t->priority - PRI_MIN + 1;
+}
+
+/* Tickets of T under the dynamic lottery: its priority tickets,
+   scaled by up to half of them in favor of threads that tend to
+   block before their quantum runs out and against threads that
+   tend to use it all up. */
+static int
+dyn_lottery_tickets (struct thread *t)
+{
+  int base = lottery_tickets (t);
+  int history = t->blocked_times + t->quantum_run_out_times + 1;
+  int tickets = base + base * (t->blocked_times - t->quantum_run_out_times)
+                       / (2 * history);
+
+  return tickets > 0 ? tickets : 1;
+}
+
+/* Enters T in the draw with TICKETS tickets, or queues it in
+   lottery_overflow if every slot is taken. */
+static void
+lottery_enqueue (struct thread *t, int tickets)
+{
+  t->tickets = tickets;
+  if (lottery_free_cnt == 0)
+    {
+      t->lottery_slot = -1;
+      list_push_back (&lottery_overflow, &t->elem);
+      return;
+    }
+
+  t->lottery_slot = lottery_free[--lottery_free_cnt];
+  lottery_slots[t->lottery_slot] = t;
+  lottery_add (t->lottery_slot, tickets);
+}
+
+/* Queues T in the prioritized lottery. */
+static void
+lottery_ready_push (struct thread *t)
+{
+  lottery_enqueue (t, lottery_tickets (t));
+}
+
+/* Queues T in the dynamic lottery. */
+static void
+dyn_lottery_ready_push (struct thread *t)
+{
+  lottery_enqueue (t, dyn_lottery_tickets (t));
+}
+
+/* Withdraws ready thread T from the draw, giving its slot to the
+   oldest thread in lottery_overflow, if any. */
+static void
+lottery_ready_remove (struct thread *t)
+{
+  if (t->lottery_slot < 0)
+    {
+      list_remove (&t->elem);
+      return;
+    }
+
+  lottery_add (t->lottery_slot, -t->tickets);
+  lottery_slots[t->lottery_slot] = NULL;
+  lottery_free[lottery_free_cnt++] = t->lottery_slot;
+  if (!list_empty (&lottery_overflow))
+    {
+      struct thread *next = list_entry (list_pop_front (&lottery_overflow),
+                                        struct thread, elem);
+      lottery_enqueue (next, next->tickets);
+    }
+}
+
+/* Sets the tickets of ready thread T to TICKETS. */
+static void
+lottery_set_tickets (struct thread *t, int tickets)
+{
+  if (t->lottery_slot >= 0)
+    lottery_add (t->lottery_slot, tickets - t->tickets);
+  t->tickets = tickets;
+}
+
+/* Recomputes the tickets of ready thread T after a priority
+   change. */
+static void
+lottery_ready_update (struct thread *t)
+{
+  lottery_set_tickets (t, lottery_tickets (t));
+}
+
+/* Same as lottery_ready_update(), for the dynamic lottery. */
+static void
+dyn_lottery_ready_update (struct thread *t)
+{
+  lottery_set_tickets (t, dyn_lottery_tickets (t));
+}
+
+/* The lottery only reschedules at the end of a quantum, unless
+   the CPU is idle. */
+static bool
+lottery_should_preempt (void)
+{
+  return running_thread () == idle_thread;
+}
+
+/* Draws a ticket and removes its holder from the draw. */
+static struct thread *
+lottery_draw (void)
+{
+  int winner = random_ulong () % lottery_total;
+  struct thread *t = lottery_slots[lottery_find (winner)];
+
+  ASSERT (is_thread (t));
+  lottery_ready_remove (t);
+  return t;
+}
+
+/** Lottery Scheduler
+ *
+ * Each ready thread holds tickets in proportion to its priority
+ * and the holder of a randomly drawn ticket runs next.
+ */
 static struct thread *
 next_thread_to_run_lottery (void)
 {
-  //OLDTODO: Implement Prioritized Lottery Scheduler
-  return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  return lottery_draw ();
 }
 
-/** Dynamic Lottery Scheduler */
+/** Dynamic Lottery Scheduler
+ *
+ * Like the lottery scheduler, but tickets are recomputed each time
+ * a thread becomes ready, from its blocking and quantum history.
+ */
 static struct thread *
 next_thread_to_run_dyn_Lottery (void)
 {
-  //OLDTODO: Implement Dynamic Priority Lottery Scheduler
-  return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  return lottery_draw ();
+}
+
+/* Sets up COUNT feedback queues, clamped to the number of run
+   queue levels, with quanta doubling from queue_quantum. */
+static void
+mq_init (int count)
+{
+  unsigned quantum = queue_quantum > 0 ? queue_quantum : TIME_SLICE;
+  int k;
+
+  if (count < 1)
+    count = 1;
+  else if (count > RUNQUEUE_LEVELS)
+    count = RUNQUEUE_LEVELS;
+  mq_count = count;
+
+  for (k = 0; k < mq_count; k++)
+    {
+      mq_quantum[k] = quantum;
+      if (quantum * 2 <= MQ_MAX_QUANTUM)
+        quantum *= 2;
+    }
+}
+
+/* Returns the ready_queue level of feedback queue K. */
+static int
+mq_level (int k)
+{
+  return RUNQUEUE_LEVELS - 1 - k;
 }
 
-/** Dual Queue Scheduler */
+/* Queues T at the back of its feedback queue.  A thread coming
+   back from being blocked (thread_unblock() pushes it before
+   marking it ready) is promoted one queue first. */
+static void
+mq_ready_push (struct thread *t)
+{
+  if (t->status == THREAD_BLOCKED && t->queue_level > 0)
+    t->queue_level--;
+  runqueue_push (&ready_queue, t, mq_level (t->queue_level));
+}
+
+/* Priority changes do not move threads between feedback
+   queues. */
+static void
+mq_ready_update (struct thread *t UNUSED)
+{
+}
+
+/* Demotes T, which used up its quantum, one queue. */
+static void
+mq_demote (struct thread *t)
+{
+  if (t != idle_thread && t->queue_level < mq_count - 1)
+    t->queue_level++;
+}
+
+/* Preempts the running thread when a higher queue is nonempty. */
+static bool
+mq_should_preempt (void)
+{
+  struct thread *cur = running_thread ();
+  int level = runqueue_max_level (&ready_queue);
+
+  if (level < 0)
+    return false;
+  return cur == idle_thread || level > mq_level (cur->queue_level);
+}
+
+/* T runs for the quantum of its queue. */
+static unsigned
+mq_time_slice (struct thread *t)
+{
+  return mq_quantum[t->queue_level];
+}
+
+/** Dual Queue Scheduler
+ *
+ * Two feedback queues: threads that use up their quantum drop to
+ * the lower queue, and go back up after blocking.  The lower
+ * queue only runs when the upper one is empty.
+ */
 static struct thread *
 next_thread_to_run_dq (void)
 {
-  //FIXME: Actually it performs FCFS (FIFO).
-  //TODO: Implement Dual Queue Scheduler
-  return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  return runqueue_pop_max (&ready_queue);
 }
 
-/** N Queues Scheduler */
+/** N Queues Scheduler
+ *
+ * Like the dual queue scheduler, with queueCount queues.  The
+ * occupancy bitmap of ready_queue finds the topmost nonempty
+ * queue in O(1) whatever the number of queues.
+ */
 static struct thread *
 next_thread_to_run_nq (void)
 {
-  //FIXME: Actually it performs FCFS (FIFO).
-  //TODO: Implement N Queues Scheduler
-  return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  return runqueue_pop_max (&ready_queue);
 }
 
 void
@@ -821,6 +1529,7 @@ pick_scheduler(void)
     case SCH_MLFQS:
       printf("Using MLFQS as the CPU Scheduler\n");
       next_thread_to_run_function = next_thread_to_run_mlfqs;
+      tick_function = mlfqs_tick;
       break;
     case SCH_PRIORITIZED:
       printf("Using a prioritized CPU Scheduler\n");
@@ -829,22 +1538,45 @@ pick_scheduler(void)
     case SCH_SIMPLE_CFS:
       printf("Using a simple implementation of the CFS as the CPU Scheduler\n");
       next_thread_to_run_function = next_thread_to_run_sCFS;
+      ready_push_function = cfs_ready_push;
+      ready_update_function = cfs_ready_update;
+      should_preempt_function = cfs_should_preempt;
+      tick_function = cfs_tick;
+      time_slice_function = cfs_time_slice;
       break;
     case SCH_LOTTERY:
       printf("Using prioritized Lottery as the CPU Scheduler\n");
       next_thread_to_run_function = next_thread_to_run_lottery;
+      ready_push_function = lottery_ready_push;
+      ready_update_function = lottery_ready_update;
+      should_preempt_function = lottery_should_preempt;
       break;
     case SCH_DYN_LOTTERY:
       printf("Using a dynamic prioritized Lottery as the CPU Scheduler\n");
       next_thread_to_run_function = next_thread_to_run_dyn_Lottery;
+      ready_push_function = dyn_lottery_ready_push;
+      ready_update_function = dyn_lottery_ready_update;
+      should_preempt_function = lottery_should_preempt;
       break;
     case SCH_DQ:
       printf("Using a dual queue CPU Scheduler\n");
       next_thread_to_run_function = next_thread_to_run_dq;
+      mq_init (2);
+      ready_push_function = mq_ready_push;
+      ready_update_function = mq_ready_update;
+      should_preempt_function = mq_should_preempt;
+      quantum_expired_function = mq_demote;
+      time_slice_function = mq_time_slice;
       break;
     case SCH_N_QUEUES:
-      printf("Using a %d-queues CPU Scheduler\n", queueCount);
+      mq_init (queueCount);
+      printf("Using a %d-queues CPU Scheduler\n", mq_count);
       next_thread_to_run_function = next_thread_to_run_nq;
+      ready_push_function = mq_ready_push;
+      ready_update_function = mq_ready_update;
+      should_preempt_function = mq_should_preempt;
+      quantum_expired_function = mq_demote;
+      time_slice_function = mq_time_slice;
       break;
     case SCH_FCFS:
     default:
@@ -862,11 +1594,10 @@ pick_scheduler(void)
 static struct thread *
 next_thread_to_run (void)
 {
-  //NOTE: This default behaviour should be moved into the next thread to run
-  //        functions if not all of them need it (they may not use ready_list).
-  if (list_empty (&ready_list))
+  if (ready_threads == 0)
     return idle_thread;
 
+  ready_threads--;
   return next_thread_to_run_function();
 }
 
@@ -900,21 +1631,27 @@ thread_schedule_tail (struct thread *prev)
 
   /* Start new time slice. */
   thread_ticks = 0;
+  time_slice = time_slice_function (cur);
 
 #ifdef USERPROG
   /* Activate the new address space. */
   process_activate ();
 #endif
 
-  /* If the thread we switched from is dying, destroy its struct
-     thread.  This must happen late so that thread_exit() doesn't
-     pull out the rug under itself.  (We don't free
-     initial_thread because its memory was not obtained via
-     palloc().) */
+  /* If the thread we switched from is dying, queue its struct
+     thread for recycling or reaping.  This must happen late so
+     that thread_exit() doesn't pull out the rug under itself.  (We
+     don't free initial_thread because its memory was not obtained
+     via palloc().) */
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      list_push_back (&zombie_list, &prev->elem);
+      if (++zombie_cnt > THREAD_PAGE_CACHE && reaper_waiting)
+        {
+          reaper_waiting = false;
+          thread_unblock (reaper_thread);
+        }
     }
 }
 
@@ -936,6 +1673,9 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  sched_trace_record (cur->status == THREAD_READY ? SCHED_EV_YIELD
+                      : cur->status == THREAD_DYING ? SCHED_EV_EXIT
+                      : SCHED_EV_SLEEP, cur, next);
   if (cur != next)
     prev = switch_threads (cur, next);
   thread_schedule_tail (prev);
@@ -943,6 +1683,116 @@ schedule (void)
   //check_priority();
 }
 
+/* Initializes run queue RQ as empty. */
+static void
+runqueue_init (struct runqueue *rq)
+{
+  int level;
+
+  for (level = 0; level < RUNQUEUE_LEVELS; level++)
+    list_init (&rq->levels[level]);
+  rq->occupied = 0;
+  rq->size = 0;
+}
+
+/* Appends T to the back of LEVEL in run queue RQ. */
+static void
+runqueue_push (struct runqueue *rq, struct thread *t, int level)
+{
+  ASSERT (0 <= level && level < RUNQUEUE_LEVELS);
+
+  list_push_back (&rq->levels[level], &t->elem);
+  rq->occupied |= (uint64_t) 1 << level;
+  rq->size++;
+  t->ready_level = level;
+}
+
+/* Removes T, which must be queued in RQ, from its level. */
+static void
+runqueue_remove (struct runqueue *rq, struct thread *t)
+{
+  int level = t->ready_level;
+
+  list_remove (&t->elem);
+  if (list_empty (&rq->levels[level]))
+    rq->occupied &= ~((uint64_t) 1 << level);
+  rq->size--;
+}
+
+/* Returns the highest nonempty level of RQ, or -1 if RQ is
+   empty.  Uses the CPU's bit scan through __builtin_clz() on
+   each 32-bit half of the bitmap. */
+static int
+runqueue_max_level (const struct runqueue *rq)
+{
+  uint32_t high = rq->occupied >> 32;
+  uint32_t low = rq->occupied;
+
+  if (high != 0)
+    return 63 - __builtin_clz (high);
+  else if (low != 0)
+    return 31 - __builtin_clz (low);
+  else
+    return -1;
+}
+
+/* Removes and returns the thread at the front of the highest
+   nonempty level of RQ, which must not be empty. */
+static struct thread *
+runqueue_pop_max (struct runqueue *rq)
+{
+  int level = runqueue_max_level (rq);
+  struct thread *t;
+
+  ASSERT (level >= 0);
+  t = list_entry (list_front (&rq->levels[level]), struct thread, elem);
+  runqueue_remove (rq, t);
+  return t;
+}
+
+/* Adds T to the run queue of the selected scheduler. */
+static void
+ready_push (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  ready_push_function (t);
+  ready_threads++;
+}
+
+/* Queues T in the priority run queue at its priority. */
+static void
+prio_ready_push (struct thread *t)
+{
+  runqueue_push (&ready_queue, t, t->priority);
+}
+
+/* Moves ready thread T to the level of its current priority. */
+static void
+prio_ready_update (struct thread *t)
+{
+  if (t->ready_level != t->priority)
+    {
+      runqueue_remove (&ready_queue, t);
+      runqueue_push (&ready_queue, t, t->priority);
+    }
+}
+
+/* Preempts the running thread if a ready thread has a higher
+   priority. */
+static bool
+prio_should_preempt (void)
+{
+  return thread_max_priority () > running_thread ()->priority;
+}
+
+/* Every thread runs for TIME_SLICE ticks. */
+static unsigned
+fixed_time_slice (struct thread *t UNUSED)
+{
+  return TIME_SLICE;
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void)
@@ -3,6 +3,7 @@
 
 #include <debug.h>
 #include <list.h>
+#include <rbtree.h>
 #include <stdint.h>
 
 /* States in a thread's life cycle. */
@@ -47,6 +48,15 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Maximum length of a chain of nested priority donations that
+   is followed when a thread blocks on a lock. */
+#define DONATION_MAX_DEPTH 8
+
+/* Thread niceness, for the MLFQS scheduler. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -115,17 +125,51 @@ struct thread
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
+    int ready_level;                    /* Run queue level while ready. */
+
+    /* Simple CFS. */
+    int64_t vruntime;                   /* Weighted virtual run time. */
+    int cfs_weight;                     /* Load weight while queued. */
+    struct rb_node cfs_node;            /* Node in the vruntime tree. */
+
+    /* Lottery. */
+    int lottery_slot;                   /* Slot in the ticket index, or -1. */
+    int tickets;                        /* Tickets held while queued. */
+
+    /* MLFQS. */
+    int nice;                           /* Niceness. */
+    int recent_cpu;                     /* Recent CPU use, fixed point. */
+
+    /* Dual queue and N queues. */
+    int queue_level;                    /* Feedback queue, 0 is the top. */
 
     /* Priority donation */
     int base_priority;                  /* Initial Priority (without donations) */
     int priority;                       /* Priority including donations */
     struct lock* waiting_on;            /* lock that thread is waiting to acquire */
-    struct list priority_donations;     /* Sorted-List for priority donations */
-    struct list_elem donation_elem;     /* Actual donation element */
+    struct list held_locks;             /* Locks held, whose waiters donate */
+    struct rb_node donor_node;          /* Node in waiting_on's donors tree */
+    int donor_priority;                 /* Priority as a donor in that tree */
+
+    /* Owned by devices/timer.c. */
+    int64_t wakeup_tick;                /* Tick at which a sleeper wakes up. */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    bool user_process;                  /* Started by process_execute(). */
+    int exit_status;                    /* Status reported on exit. */
+    struct wait_status *wait_status;    /* This process's completion state. */
+    struct list children;               /* Completion states of children. */
+
+    /* Owned by userprog/syscall.c. */
+    struct file **files;                /* Open files, indexed by fd. */
+    struct bitmap *fd_map;              /* File descriptors in use. */
+#endif
+
+#ifdef FILESYS
+    /* Owned by filesys/filesys.c. */
+    struct inode *cwd;                  /* Working directory, null for root. */
 #endif
 
     /* Owned by thread.c. */
@@ -138,6 +182,7 @@ struct thread
     int running_times;
 
     int ready_state_time;
+    int64_t ready_tick;                 /* When it last became ready. */
     int quantum_run_out_times;
     int expropied_times;
     int global_ticks_entry;
@@ -163,6 +208,11 @@ int global_ticks;
  *   - "sCFS"
  */
 extern enum scheduling_algorithm selected_scheduler;
+
+/* Quantum, in ticks, of the top queue of the dual queue and N
+   queues schedulers.  Each lower queue doubles it.  Set by the
+   kernel command-line option "-quantum=TICKS". */
+extern int queue_quantum;
 void pick_scheduler(void);
 
 void thread_init (void);
@@ -191,7 +241,9 @@ void thread_foreach (thread_action_func *, void *);
 
 void thread_calculate_priority(struct thread *t);
 void thread_donate_priority(struct thread *t);
+void thread_make_donation(struct thread *t, struct lock *lock);
 bool thread_priority_cmp (const struct list_elem *t1, const struct list_elem *t2, void *unused UNUSED);
+bool thread_donor_cmp (const struct rb_node *a, const struct rb_node *b, void *unused UNUSED);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
@@ -7,27 +7,63 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h" 
 
+/* Tracks the completion of a process.
+
+   A parent process and its child share one of these: the child
+   fills in its exit code and ups `dead' when it exits, and the
+   parent downs `dead' in process_wait() to collect the exit code,
+   instead of polling.  Whichever of the two exits last frees it,
+   so it outlives the child for as long as the parent might wait,
+   and no longer. */
+struct wait_status
+  {
+    struct list_elem elem;      /* Element in parent's `children' list. */
+    struct lock lock;           /* Protects `ref_cnt'. */
+    int ref_cnt;                /* 2 = child and parent both alive,
+                                   1 = either child or parent alive,
+                                   0 = neither alive. */
+    tid_t tid;                  /* Child thread id. */
+    int exit_code;              /* Child exit code, if dead. */
+    struct semaphore dead;      /* 1 = child alive, 0 = child dead. */
+  };
+
+/* Data passed from process_execute() to start_process(). */
+struct exec_info
+  {
+    char *file_name;            /* Command line, in a page. */
+    struct semaphore loaded;    /* Upped when loading is finished. */
+    struct wait_status *wait_status; /* Child's completion state. */
+    struct inode *cwd;          /* Working directory to inherit. */
+    bool success;               /* Whether the program was loaded. */
+  };
+
 static thread_func start_process NO_RETURN;
+static void release_wait_status (struct wait_status *);
 static bool load (const char *cmdline, void (**eip) (void), void **esp, char** save_ptr);
 
 /* Starts a new thread running a user program loaded from
-   FILENAME.  The new thread may be scheduled (and may even exit)
-   before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
+   FILENAME and waits for it to be loaded.  Returns the new
+   process's thread id, or TID_ERROR if the thread cannot be
+   created or the program cannot be loaded. */
 tid_t
 process_execute (const char *file_name)
 {
+  struct exec_info exec;
   char *fn_copy;
   tid_t tid;
 
@@ -42,22 +78,43 @@ process_execute (const char *file_name)
   char *save_ptr;
   file_name = strtok_r((char*) file_name, " ", &save_ptr);
 
-  /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (file_name, PRI_DEFAULT, start_process, fn_copy);
+  /* Create a new thread to execute FILE_NAME, and wait for it
+     to load. */
+  exec.file_name = fn_copy;
+  sema_init (&exec.loaded, 0);
+  lock_acquire (&filesys_lock);
+  exec.cwd = inode_reopen (thread_current ()->cwd);
+  lock_release (&filesys_lock);
+  tid = thread_create (file_name, PRI_DEFAULT, start_process, &exec);
   if (tid == TID_ERROR)
-    palloc_free_page (fn_copy);
-  return tid;
+    {
+      lock_acquire (&filesys_lock);
+      inode_close (exec.cwd);
+      lock_release (&filesys_lock);
+      palloc_free_page (fn_copy);
+      return TID_ERROR;
+    }
+  sema_down (&exec.loaded);
+
+  if (exec.wait_status != NULL)
+    list_push_back (&thread_current ()->children, &exec.wait_status->elem);
+  return exec.success ? tid : TID_ERROR;
 }
 
 /* A thread function that loads a user process and starts it
    running. */
 static void
-start_process (void *file_name_)
+start_process (void *exec_)
 {
-  char *file_name = file_name_;
+  struct exec_info *exec = exec_;
+  struct thread *cur = thread_current ();
+  char *file_name = exec->file_name;
   struct intr_frame if_;
   bool success;
 
+  cur->user_process = true;
+  cur->cwd = exec->cwd;
+
   char *save_ptr;
   file_name = strtok_r((char*) file_name, " ", &save_ptr);
 
@@ -67,8 +124,32 @@ start_process (void *file_name_)
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
   success = load (file_name, &if_.eip, &if_.esp, &save_ptr);
-  /* If load failed, quit. */
   palloc_free_page (file_name);
+
+  /* Allocate the state shared with our parent. */
+  if (success)
+    {
+      cur->wait_status = malloc (sizeof *cur->wait_status);
+      success = cur->wait_status != NULL;
+    }
+  if (success)
+    {
+      struct wait_status *ws = cur->wait_status;
+
+      lock_init (&ws->lock);
+      ws->ref_cnt = 2;
+      ws->tid = cur->tid;
+      ws->exit_code = -1;
+      sema_init (&ws->dead, 0);
+    }
+
+  /* Notify our parent.  EXEC lives on its stack, so we must not
+     touch it after this. */
+  exec->wait_status = cur->wait_status;
+  exec->success = success;
+  sema_up (&exec->loaded);
+
+  /* If load failed, quit. */
   if (!success)
     thread_exit ();
 
@@ -87,24 +168,81 @@ start_process (void *file_name_)
    exception), returns -1.  If TID is invalid or if it was not a
    child of the calling process, or if process_wait() has already
    been successfully called for the given TID, returns -1
-   immediately, without waiting.
-
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+   immediately, without waiting. */
 int
-process_wait (tid_t child_tid UNUSED)
+process_wait (tid_t child_tid)
 {
-  while(1);  //FIXME: Should not wait THAT long.
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&cur->children); e != list_end (&cur->children);
+       e = list_next (e))
+    {
+      struct wait_status *ws = list_entry (e, struct wait_status, elem);
+      if (ws->tid == child_tid)
+        {
+          int exit_code;
+
+          list_remove (e);
+          sema_down (&ws->dead);
+          exit_code = ws->exit_code;
+          release_wait_status (ws);
+          return exit_code;
+        }
+    }
   return -1;
 }
 
+/* Drops a reference to WS, freeing it if that was the last. */
+static void
+release_wait_status (struct wait_status *ws)
+{
+  int new_ref_cnt;
+
+  lock_acquire (&ws->lock);
+  new_ref_cnt = --ws->ref_cnt;
+  lock_release (&ws->lock);
+
+  if (new_ref_cnt == 0)
+    free (ws);
+}
+
 /* Free the current process's resources. */
 void
 process_exit (void)
 {
   struct thread *cur = thread_current ();
+  struct list_elem *e, *next;
   uint32_t *pd;
 
+  /* Tell our parent our exit code. */
+  if (cur->wait_status != NULL)
+    {
+      struct wait_status *ws = cur->wait_status;
+
+      ws->exit_code = cur->exit_status;
+      sema_up (&ws->dead);
+      release_wait_status (ws);
+    }
+
+  /* Our children no longer have a parent to wait for them. */
+  for (e = list_begin (&cur->children); e != list_end (&cur->children);
+       e = next)
+    {
+      struct wait_status *ws = list_entry (e, struct wait_status, elem);
+      next = list_remove (e);
+      release_wait_status (ws);
+    }
+
+  /* Close our files and working directory.  This must not depend
+     on having a page directory, since load() may have failed to
+     create one. */
+  if (cur->user_process)
+    {
+      printf ("%s: exit(%d)\n", cur->name, cur->exit_status);
+      syscall_exit ();
+    }
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -228,12 +366,14 @@ load (const char *file_name, void (**eip) (void), void **esp, char** save_ptr)
   /* Allocate and activate page directory. */
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL)
-    goto done;
+    return false;
   process_activate ();
 
 
 
-  /* Open executable file. */
+  /* Open executable file.  filesys_lock is held until the file
+     is closed, since the file system is not thread-safe. */
+  lock_acquire (&filesys_lock);
   file = filesys_open (file_name);
   if (file == NULL)
     {
@@ -325,6 +465,7 @@ load (const char *file_name, void (**eip) (void), void **esp, char** save_ptr)
  done:
   /* We arrive here whether the load is successful or not. */
   file_close (file);
+  lock_release (&filesys_lock);
   return success;
 }
 
@@ -1,113 +1,622 @@
 #include "userprog/syscall.h"
+#include <bitmap.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include "devices/input.h"
+#include "devices/shutdown.h"
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
 
+/* System calls.
 
-// Implementation Parameters
-// =========================
-static int WRITE_SIZE=128;
+   The user program pushes the system call number and then its
+   arguments, each a 32-bit word, on its stack and invokes
+   interrupt 0x30.  syscall_handler() looks the number up in
+   syscall_table[], which gives the handler and the number of
+   arguments it takes, and calls the handler with a pointer to
+   the arguments.  The handler's return value goes back to the
+   user program in eax.
 
+   User pointers are checked cheaply.  A pointer is rejected if it
+   is not below PHYS_BASE, and otherwise simply dereferenced, once
+   per page, by get_user() or put_user().  If the page is not
+   mapped, the page fault handler makes the access fail instead of
+   killing the kernel (see page_fault() in exception.c), so no
+   page table walk is needed.  A process that passes a bad
+   pointer is terminated with exit status -1.
 
+   Each process has a table of open files, an array indexed by
+   file descriptor, so that read() and write() find their file in
+   constant time.  A bitmap marks the descriptors in use, with 0
+   and 1 reserved for the console, and open() takes the lowest
+   free one.  Both start with FD_INITIAL entries and double in
+   size whenever they fill up. */
 
-inline
-int
-syscall_write(struct intr_frame *f)
-{
-  int *p = f->esp;  // Stack pointer (x86 registers http://www.scs.stanford.edu/05au-cs240c/lab/i386/s02_03.htm)
+/* Initial size of a process's file descriptor table. */
+#define FD_INITIAL 16
 
-  // FIXME: This is (probably) displaced because of the -12 on process.c:442 (setup_stack)
-  int sp_offset = 0;  // after removing the -=12, decreasing this should fix this
+/* Console writes are done in chunks of this many bytes, so that
+   putbuf() does not hold the console lock for too long. */
+#define WRITE_SIZE 128
 
-  int file_descriptor =         p[sp_offset+1];
-  char        *buffer = (char*) p[sp_offset+2];
-  int            size = (int)   p[sp_offset+3];
+/* A system call handler.  ARGS points to the call's arguments,
+   which have been checked to be readable.  Returns the value to
+   put in the caller's eax. */
+typedef uint32_t syscall_func (const uint32_t *args);
 
-  switch(file_descriptor)
+/* A system call. */
+struct syscall
   {
-    case STDIN_FILENO:
-      // Inform that no data was written
-      f->eax=0;
-      return 2;
+    syscall_func *func;         /* Handler. */
+    size_t arg_cnt;             /* Number of arguments. */
+  };
+
+static syscall_func sys_halt, sys_exit, sys_exec, sys_wait;
+static syscall_func sys_create, sys_remove, sys_open, sys_filesize;
+static syscall_func sys_read, sys_write, sys_seek, sys_tell, sys_close;
+static syscall_func sys_chdir, sys_mkdir, sys_readdir, sys_isdir;
+static syscall_func sys_inumber;
+
+/* System calls, indexed by number.  Calls without a handler are
+   not implemented. */
+static const struct syscall syscall_table[] =
+  {
+    [SYS_HALT] = {sys_halt, 0},
+    [SYS_EXIT] = {sys_exit, 1},
+    [SYS_EXEC] = {sys_exec, 1},
+    [SYS_WAIT] = {sys_wait, 1},
+    [SYS_CREATE] = {sys_create, 2},
+    [SYS_REMOVE] = {sys_remove, 1},
+    [SYS_OPEN] = {sys_open, 1},
+    [SYS_FILESIZE] = {sys_filesize, 1},
+    [SYS_READ] = {sys_read, 3},
+    [SYS_WRITE] = {sys_write, 3},
+    [SYS_SEEK] = {sys_seek, 2},
+    [SYS_TELL] = {sys_tell, 1},
+    [SYS_CLOSE] = {sys_close, 1},
+    [SYS_CHDIR] = {sys_chdir, 1},
+    [SYS_MKDIR] = {sys_mkdir, 1},
+    [SYS_READDIR] = {sys_readdir, 2},
+    [SYS_ISDIR] = {sys_isdir, 1},
+    [SYS_INUMBER] = {sys_inumber, 1},
+  };
+
+/* Serializes file system operations. */
+struct lock filesys_lock;
+
+static void syscall_handler (struct intr_frame *);
+static void exit_process (int status) NO_RETURN;
+static void check_user (const void *uaddr, size_t size, bool write);
+static char *copy_in_string (const char *us);
+static int fd_alloc (struct file *);
+static struct file *fd_lookup (int fd);
+static bool is_dir (struct file *);
+
+void
+syscall_init (void)
+{
+  intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+  lock_init (&filesys_lock);
+}
+
+/* System call handler. */
+static void
+syscall_handler (struct intr_frame *f)
+{
+  const uint32_t *sp = f->esp;
+  const struct syscall *sc;
+  uint32_t nr;
+
+  check_user (sp, sizeof *sp, false);
+  nr = *sp;
+  if (nr >= sizeof syscall_table / sizeof *syscall_table
+      || syscall_table[nr].func == NULL)
+    exit_process (-1);
+
+  sc = &syscall_table[nr];
+  check_user (sp + 1, sc->arg_cnt * sizeof *sp, false);
+  f->eax = sc->func (sp + 1);
+}
+
+/* Halts the machine. */
+static uint32_t
+sys_halt (const uint32_t *args UNUSED)
+{
+  shutdown_power_off ();
+}
+
+/* Terminates the process with exit status ARGS[0]. */
+static uint32_t
+sys_exit (const uint32_t *args)
+{
+  exit_process (args[0]);
+}
+
+/* Runs the command line ARGS[0] in a new process and returns its
+   tid, or -1 if it could not be started. */
+static uint32_t
+sys_exec (const uint32_t *args)
+{
+  char *cmd_line = copy_in_string ((const char *) args[0]);
+  tid_t tid = process_execute (cmd_line);
+
+  palloc_free_page (cmd_line);
+  return tid;
+}
+
+/* Waits for child process ARGS[0] and returns its exit status. */
+static uint32_t
+sys_wait (const uint32_t *args)
+{
+  return process_wait (args[0]);
+}
+
+/* Creates file ARGS[0] with initial size ARGS[1] bytes.  Returns
+   true if successful. */
+static uint32_t
+sys_create (const uint32_t *args)
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  bool success;
+
+  lock_acquire (&filesys_lock);
+  success = filesys_create (name, args[1]);
+  lock_release (&filesys_lock);
+
+  palloc_free_page (name);
+  return success;
+}
+
+/* Deletes file ARGS[0].  Returns true if successful. */
+static uint32_t
+sys_remove (const uint32_t *args)
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  bool success;
 
-    case STDOUT_FILENO:
+  lock_acquire (&filesys_lock);
+  success = filesys_remove (name);
+  lock_release (&filesys_lock);
+
+  palloc_free_page (name);
+  return success;
+}
+
+/* Opens file ARGS[0] and returns a file descriptor for it, or -1
+   on failure. */
+static uint32_t
+sys_open (const uint32_t *args)
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  struct file *file;
+  int fd = -1;
+
+  lock_acquire (&filesys_lock);
+  file = filesys_open (name);
+  if (file != NULL)
     {
-      // Write in chunks of WRITE_SIZE
-      //   putbuf (src/lib/kernel/console.c) locks the console,
-      //   we should avoid locking it too often or for too long
-      int remaining = size;
-      while(remaining > WRITE_SIZE)
-      {
-        // Write a chunk
-        putbuf(buffer, WRITE_SIZE);
-        // Advance buffer pointer
-        buffer    += WRITE_SIZE;
-        remaining -= WRITE_SIZE;
-      }
-      // Write all the remaining data
-      putbuf(buffer, remaining);
-
-      // Inform the amount of data written
-      f->eax=(int)size;
-      return 0;
+      fd = fd_alloc (file);
+      if (fd < 0)
+        file_close (file);
     }
+  lock_release (&filesys_lock);
 
-    default:
-      printf("syscall: write call not implemented for files\n");
-      return 1;
-  }
+  palloc_free_page (name);
+  return fd;
+}
+
+/* Returns the size of the file open as ARGS[0], or -1. */
+static uint32_t
+sys_filesize (const uint32_t *args)
+{
+  struct file *file = fd_lookup (args[0]);
+  off_t length;
 
-  return 1;  // Unreachable, but compiler complains
+  if (file == NULL)
+    return -1;
+
+  lock_acquire (&filesys_lock);
+  length = file_length (file);
+  lock_release (&filesys_lock);
+  return length;
 }
 
+/* Reads ARGS[2] bytes from file descriptor ARGS[0] into buffer
+   ARGS[1].  Returns the number of bytes read, or -1 on failure. */
+static uint32_t
+sys_read (const uint32_t *args)
+{
+  int fd = args[0];
+  uint8_t *buffer = (uint8_t *) args[1];
+  unsigned size = args[2];
+  struct file *file;
+  off_t bytes_read;
 
+  check_user (buffer, size, true);
+  if (fd == STDIN_FILENO)
+    {
+      unsigned i;
 
-static void
-syscall_handler (struct intr_frame *f)
+      for (i = 0; i < size; i++)
+        buffer[i] = input_getc ();
+      return size;
+    }
+
+  file = fd_lookup (fd);
+  if (file == NULL || is_dir (file))
+    return -1;
+
+  lock_acquire (&filesys_lock);
+  bytes_read = file_read (file, buffer, size);
+  lock_release (&filesys_lock);
+  return bytes_read;
+}
+
+/* Writes ARGS[2] bytes from buffer ARGS[1] to file descriptor
+   ARGS[0].  Returns the number of bytes written, or -1 on
+   failure. */
+static uint32_t
+sys_write (const uint32_t *args)
 {
-  // intr_frame holds CPU register data
-  //   Intel 80386 Reference Programmer's Manual (TL;DR)
-  //     http://www.scs.stanford.edu/05au-cs240c/lab/i386/toc.htm
+  int fd = args[0];
+  const char *buffer = (const char *) args[1];
+  unsigned size = args[2];
+  struct file *file;
+  off_t bytes_written;
 
-  int *p = f->esp;  // Stack pointer (x86 registers http://www.scs.stanford.edu/05au-cs240c/lab/i386/s02_03.htm)
-  int syscall_number = (*p);
+  check_user (buffer, size, false);
+  if (fd == STDOUT_FILENO)
+    {
+      unsigned remaining;
 
-  switch(syscall_number)
-  {
-    case SYS_HALT:
-      printf("system call: halt\n");
-      break;
+      for (remaining = size; remaining > WRITE_SIZE;
+           remaining -= WRITE_SIZE)
+        {
+          putbuf (buffer, WRITE_SIZE);
+          buffer += WRITE_SIZE;
+        }
+      putbuf (buffer, remaining);
+      return size;
+    }
 
-    case SYS_EXIT:
-      printf("system call: exit\n");
-      break;
+  file = fd_lookup (fd);
+  if (file == NULL || is_dir (file))
+    return -1;
 
-    case SYS_EXEC:
-      printf("system call: exec\n");
-      break;
+  lock_acquire (&filesys_lock);
+  bytes_written = file_write (file, buffer, size);
+  lock_release (&filesys_lock);
+  return bytes_written;
+}
 
-    case SYS_WAIT:
-      printf("system call: wait\n");
-      break;
+/* Sets the position of the file open as ARGS[0] to ARGS[1]. */
+static uint32_t
+sys_seek (const uint32_t *args)
+{
+  struct file *file = fd_lookup (args[0]);
 
-    case SYS_WRITE:
-      syscall_write(f);
-      return;
+  if (file != NULL)
+    {
+      lock_acquire (&filesys_lock);
+      file_seek (file, args[1]);
+      lock_release (&filesys_lock);
+    }
+  return 0;
+}
 
-    default:
-      printf("system call: unhandled syscall. Terminating process[%d]\n",
-             thread_current()->tid);
-      break;
-  }
+/* Returns the position of the file open as ARGS[0], or -1. */
+static uint32_t
+sys_tell (const uint32_t *args)
+{
+  struct file *file = fd_lookup (args[0]);
+  off_t position;
 
-  // Syscall handling failed, terminate the process
-  thread_exit ();
+  if (file == NULL)
+    return -1;
+
+  lock_acquire (&filesys_lock);
+  position = file_tell (file);
+  lock_release (&filesys_lock);
+  return position;
 }
 
+/* Closes file descriptor ARGS[0]. */
+static uint32_t
+sys_close (const uint32_t *args)
+{
+  struct thread *cur = thread_current ();
+  int fd = args[0];
+  struct file *file = fd_lookup (fd);
+
+  if (file != NULL)
+    {
+      cur->files[fd] = NULL;
+      bitmap_reset (cur->fd_map, fd);
+
+      lock_acquire (&filesys_lock);
+      file_close (file);
+      lock_release (&filesys_lock);
+    }
+  return 0;
+}
+
+/* Changes the working directory to ARGS[0].  Returns true if
+   successful. */
+static uint32_t
+sys_chdir (const uint32_t *args)
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  bool success;
 
+  lock_acquire (&filesys_lock);
+  success = filesys_chdir (name);
+  lock_release (&filesys_lock);
+
+  palloc_free_page (name);
+  return success;
+}
+
+/* Creates directory ARGS[0].  Returns true if successful. */
+static uint32_t
+sys_mkdir (const uint32_t *args)
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  bool success;
+
+  lock_acquire (&filesys_lock);
+  success = filesys_mkdir (name);
+  lock_release (&filesys_lock);
+
+  palloc_free_page (name);
+  return success;
+}
+
+/* Reads the next entry from the directory open as ARGS[0] and
+   stores its name into ARGS[1], which must have room for
+   NAME_MAX + 1 bytes.  Returns true if successful, false if the
+   directory has no more entries or ARGS[0] is not a directory. */
+static uint32_t
+sys_readdir (const uint32_t *args)
+{
+  struct file *file = fd_lookup (args[0]);
+  char *name = (char *) args[1];
+  char entry[NAME_MAX + 1];
+  bool success;
+  off_t pos;
+
+  check_user (name, sizeof entry, true);
+  if (file == NULL || !is_dir (file))
+    return false;
+
+  lock_acquire (&filesys_lock);
+  pos = file_tell (file);
+  success = dir_readdir_at (file_get_inode (file), &pos, entry);
+  file_seek (file, pos);
+  lock_release (&filesys_lock);
+
+  if (success)
+    memcpy (name, entry, sizeof entry);
+  return success;
+}
+
+/* Returns true if ARGS[0] is open as a directory. */
+static uint32_t
+sys_isdir (const uint32_t *args)
+{
+  struct file *file = fd_lookup (args[0]);
+
+  return file != NULL && is_dir (file);
+}
+
+/* Returns the inode number of the file open as ARGS[0], or -1. */
+static uint32_t
+sys_inumber (const uint32_t *args)
+{
+  struct file *file = fd_lookup (args[0]);
+
+  if (file == NULL)
+    return -1;
+  return inode_get_inumber (file_get_inode (file));
+}
+
+/* Closes all of the current process's files, frees its file
+   descriptor table, and releases its working directory.  Called
+   when a process exits. */
 void
-syscall_init (void)
+syscall_exit (void)
+{
+  struct thread *cur = thread_current ();
+  size_t fd;
+
+  lock_acquire (&filesys_lock);
+  inode_close (cur->cwd);
+  cur->cwd = NULL;
+  if (cur->fd_map != NULL)
+    for (fd = 0; fd < bitmap_size (cur->fd_map); fd++)
+      if (cur->files[fd] != NULL)
+        file_close (cur->files[fd]);
+  lock_release (&filesys_lock);
+
+  free (cur->files);
+  if (cur->fd_map != NULL)
+    bitmap_destroy (cur->fd_map);
+  cur->files = NULL;
+  cur->fd_map = NULL;
+}
+
+/* Grows the current process's file descriptor table, which is
+   full, to twice its size, or creates it with FD_INITIAL entries
+   if it does not exist yet.  Returns true if successful, false if
+   memory is not available. */
+static bool
+fd_grow (void)
+{
+  struct thread *cur = thread_current ();
+  size_t old_cnt = cur->fd_map != NULL ? bitmap_size (cur->fd_map) : 0;
+  size_t new_cnt = old_cnt > 0 ? old_cnt * 2 : FD_INITIAL;
+  struct file **files;
+  struct bitmap *fd_map;
+  size_t fd;
+
+  fd_map = bitmap_create (new_cnt);
+  if (fd_map == NULL)
+    return false;
+  files = realloc (cur->files, new_cnt * sizeof *files);
+  if (files == NULL)
+    {
+      bitmap_destroy (fd_map);
+      return false;
+    }
+  for (fd = old_cnt; fd < new_cnt; fd++)
+    files[fd] = NULL;
+
+  /* The table only grows when every descriptor is in use, and the
+     console descriptors are always reserved. */
+  bitmap_set_multiple (fd_map, 0, old_cnt > 0 ? old_cnt : STDOUT_FILENO + 1,
+                       true);
+  if (cur->fd_map != NULL)
+    bitmap_destroy (cur->fd_map);
+  cur->files = files;
+  cur->fd_map = fd_map;
+  return true;
+}
+
+/* Adds FILE to the current process's file descriptor table and
+   returns its new file descriptor, the lowest one free, or -1 if
+   memory is not available. */
+static int
+fd_alloc (struct file *file)
+{
+  struct thread *cur = thread_current ();
+  size_t fd = BITMAP_ERROR;
+
+  if (cur->fd_map != NULL)
+    fd = bitmap_scan_and_flip (cur->fd_map, 0, 1, false);
+  if (fd == BITMAP_ERROR)
+    {
+      if (!fd_grow ())
+        return -1;
+      fd = bitmap_scan_and_flip (cur->fd_map, 0, 1, false);
+      ASSERT (fd != BITMAP_ERROR);
+    }
+
+  cur->files[fd] = file;
+  return fd;
+}
+
+/* Returns the file open as FD in the current process, or a null
+   pointer if FD is not open or is a console descriptor. */
+static struct file *
+fd_lookup (int fd)
 {
-  intr_register_int (0x30, 3, INTR_ON, &syscall_handler, "syscall");
+  struct thread *cur = thread_current ();
+
+  if (cur->fd_map == NULL || fd < 0
+      || (size_t) fd >= bitmap_size (cur->fd_map))
+    return NULL;
+  return cur->files[fd];
+}
+
+/* Returns true if FILE is a directory. */
+static bool
+is_dir (struct file *file)
+{
+  return inode_is_dir (file_get_inode (file));
+}
+
+/* Terminates the current process with exit status STATUS. */
+static void
+exit_process (int status)
+{
+  thread_current ()->exit_status = status;
+  thread_exit ();
+}
+
+/* Reads a byte at user virtual address UADDR, which must be below
+   PHYS_BASE.  Returns the byte value if successful, -1 if UADDR
+   is not mapped. */
+static int
+get_user (const uint8_t *uaddr)
+{
+  int result;
+  asm ("movl $1f, %0; movzbl %1, %0; 1:"
+       : "=&a" (result) : "m" (*uaddr));
+  return result;
+}
+
+/* Writes BYTE to user address UDST, which must be below
+   PHYS_BASE.  Returns true if successful, false if UDST is not
+   mapped writable. */
+static bool
+put_user (uint8_t *udst, uint8_t byte)
+{
+  int error_code;
+  asm ("movl $1f, %0; movb %b2, %1; 1:"
+       : "=&a" (error_code), "=m" (*udst) : "q" (byte));
+  return error_code != -1;
+}
+
+/* Checks that the SIZE bytes of user memory at UADDR can be read,
+   and also written if WRITE is true, terminating the process if
+   not.  Touches one byte per page, since a page is mapped or not
+   as a whole. */
+static void
+check_user (const void *uaddr, size_t size, bool write)
+{
+  const uint8_t *p = uaddr;
+  const uint8_t *end = p + size;
+
+  if (size == 0)
+    return;
+  if (end < p || !is_user_vaddr (end - 1))
+    exit_process (-1);
+
+  while (p < end)
+    {
+      int byte = get_user (p);
+      if (byte == -1 || (write && !put_user ((uint8_t *) p, byte)))
+        exit_process (-1);
+      p = (const uint8_t *) pg_round_down (p) + PGSIZE;
+    }
+}
+
+/* Copies the null-terminated string at user address US into a
+   newly allocated page and returns it.  The caller must free the
+   page with palloc_free_page().  Terminates the process if US is
+   a bad pointer or the string does not fit in a page. */
+static char *
+copy_in_string (const char *us)
+{
+  char *ks = palloc_get_page (0);
+  size_t i;
+
+  if (ks == NULL)
+    exit_process (-1);
+
+  for (i = 0; i < PGSIZE; i++)
+    {
+      int c;
+
+      if (!is_user_vaddr (us + i))
+        break;
+      c = get_user ((const uint8_t *) us + i);
+      if (c == -1)
+        break;
+      ks[i] = c;
+      if (c == '\0')
+        return ks;
+    }
+
+  palloc_free_page (ks);
+  exit_process (-1);
 }